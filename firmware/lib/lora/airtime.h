@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdint.h>
+
+// LoRa packet time on air, as in the SX1276 datasheet (4.1.1.7) and Semtech
+// AN1200.13. Usable in constant expressions (C++11), so fixed configurations
+// can be checked at compile time.
+//
+// The bandwidth is given as the divider of 500 kHz, which makes the symbol
+// time an exact number of microseconds for every SX127x bandwidth:
+//
+//   500k = 1, 250k = 2, 125k = 4, 62.5k = 8, 41.7k = 12,
+//   31.25k = 16, 20.8k = 24, 15.6k = 32, 10.4k = 48, 7.8k = 64
+//
+// Coding rate is 1..4 for 4/5..4/8. SF6 only works with implicit header.
+namespace lora {
+
+// Symbol time 2^SF / BW
+constexpr uint32_t symbol_time_us(uint8_t sf, uint8_t bw_div) {
+    return (2UL << sf) * bw_div;
+}
+
+// Low data rate optimization is mandated for symbols longer than 16 ms
+constexpr bool low_data_rate(uint8_t sf, uint8_t bw_div) {
+    return symbol_time_us(sf, bw_div) > 16000;
+}
+
+constexpr int32_t ceil_div(int32_t a, int32_t b) {
+    return (a > 0) ? (a + b - 1) / b : 0;
+}
+
+// Number of symbols after the preamble (header and payload)
+constexpr uint32_t payload_symbols(uint8_t length, uint8_t sf, uint8_t cr,
+    bool crc, bool implicit_header, bool ldro)
+{
+    return 8 + ceil_div(8 * length - 4 * sf + 28 + (crc ? 16 : 0) - (implicit_header ? 20 : 0),
+        4 * (sf - (ldro ? 2 : 0))) * (cr + 4);
+}
+
+// Whole packet including the preamble (preamble_length + 4.25 symbols)
+constexpr uint32_t time_on_air_us(uint8_t length, uint8_t sf, uint8_t bw_div, uint8_t cr,
+    uint16_t preamble_length = 8, bool crc = true, bool implicit_header = false)
+{
+    return (4 * preamble_length + 17 + 4 * payload_symbols(length, sf, cr, crc,
+        implicit_header || sf == 6, low_data_rate(sf, bw_div))) * (symbol_time_us(sf, bw_div) / 4);
+}
+
+constexpr uint32_t time_on_air_ms(uint8_t length, uint8_t sf, uint8_t bw_div, uint8_t cr,
+    uint16_t preamble_length = 8, bool crc = true, bool implicit_header = false)
+{
+    return (time_on_air_us(length, sf, bw_div, cr, preamble_length, crc, implicit_header) + 999) / 1000;
+}
+
+// Token bucket limiting the average duty cycle. The budget accrues at
+// duty_permille of the elapsed time, up to the share of one window, and
+// starts full.
+class AirtimeBudget {
+public:
+    AirtimeBudget(uint16_t duty_permille, uint32_t window_ms) :
+        _duty(duty_permille), _limit(window_ms * duty_permille),
+        _credit(window_ms * duty_permille), _last_update(0) {}
+
+    void update(uint32_t now_ms) {
+        uint32_t elapsed = now_ms - _last_update;
+        _last_update = now_ms;
+        if (_duty == 0) return;
+        if (elapsed > _limit / _duty) elapsed = _limit / _duty;
+        _credit += elapsed * _duty;
+        if (_credit > _limit) _credit = _limit;
+    }
+
+    // Takes airtime_ms from the budget if there is enough left
+    bool consume(uint32_t airtime_ms) {
+        if (airtime_ms * 1000 > _credit) return false;
+        _credit -= airtime_ms * 1000;
+        return true;
+    }
+
+    // Airtime available right now, milliseconds
+    uint32_t available() const {
+        return _credit / 1000;
+    }
+
+private:
+    uint16_t    _duty;
+    uint32_t    _limit;         // milliseconds x permille
+    uint32_t    _credit;        // milliseconds x permille
+    uint32_t    _last_update;
+};
+
+}
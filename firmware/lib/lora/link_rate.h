@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdint.h>
+
+// Adaptive data rate
+//
+// The payload steps through a schedule of modem settings, from the most
+// robust (the default) to the fastest. Each binary telemetry frame announces
+// the rate of the following frame, so the ground station can follow. After
+// every binary frame it hears, the ground station replies with a link report
+// (the SNR and RSSI it measured) at the same rate, and the payload picks the
+// fastest rate that still leaves the required SNR margin. Without reports
+// both sides fall back to the default rate.
+//
+// Link report frame (ground to payload), multi-byte fields little endian:
+//
+//   offset size
+//      0    1  magic and version (LINK_REPORT_MAGIC)
+//      1    1  payload id (see telemetry_frame.h)
+//      2    2  message id of the frame heard
+//      4    1  rate index the frame was heard at
+//      5    1  packet SNR, dB (signed)
+//      6    1  packet RSSI, dBm (signed)
+#define LINK_REPORT_VERSION     1
+#define LINK_REPORT_MAGIC       (0xB0 | LINK_REPORT_VERSION)
+#define LINK_REPORT_LENGTH      7
+
+#define LINK_MARGIN_DB          10      // SNR margin kept above the demodulation floor
+#define LINK_REPORT_TIMEOUT     3       // frames without a report before falling back
+
+namespace lora {
+
+struct RateStep {
+    uint8_t sf;
+    uint8_t bw_div;         // divider of 500 kHz (see airtime.h)
+    uint8_t interval_s;     // telemetry period at this rate
+};
+
+// The telemetry period shrinks with the time on air, at a similar duty cycle
+static const RateStep rate_schedule[] = {
+    { 10, 4, 5 },   // 125 kHz, the default
+    {  9, 4, 3 },
+    {  8, 4, 2 },
+    {  7, 4, 1 },
+    {  7, 2, 1 },   // 250 kHz
+};
+
+static const uint8_t rate_count = sizeof(rate_schedule) / sizeof(rate_schedule[0]);
+
+// SNR needed for demodulation (SX1276 datasheet), dB x 4
+constexpr int16_t snr_floor_q4(uint8_t sf) {
+    return -20 - 10 * (sf - 6);
+}
+
+// Noise grows by 3 dB per doubling of the bandwidth (dB x 4)
+inline int16_t bandwidth_gain_q4(uint8_t from_div, uint8_t to_div) {
+    int16_t gain = 0;
+    for (; from_div < to_div; from_div *= 2) gain += 12;
+    for (; from_div > to_div; from_div /= 2) gain -= 12;
+    return gain;
+}
+
+// Fastest rate with the required margin for an SNR measured at heard_rate
+inline uint8_t best_rate(uint8_t heard_rate, int8_t snr_db, uint8_t margin_db = LINK_MARGIN_DB) {
+    uint8_t best = 0;
+    for (uint8_t rate = 1; rate < rate_count; rate++) {
+        int16_t snr_q4 = snr_db * 4 + bandwidth_gain_q4(rate_schedule[heard_rate].bw_div, rate_schedule[rate].bw_div);
+        if (snr_q4 - snr_floor_q4(rate_schedule[rate].sf) >= margin_db * 4) best = rate;
+    }
+    return best;
+}
+
+// Rate for the next frame: slows down right away when the margin is gone,
+// speeds up one step per report
+inline uint8_t next_rate(uint8_t current, uint8_t heard_rate, int8_t snr_db) {
+    if (heard_rate >= rate_count) return 0;
+    uint8_t best = best_rate(heard_rate, snr_db);
+    if (best > current) return current + 1;
+    return best;
+}
+
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdint.h>
+
+// Binary telemetry frame, sent instead of the UKHAS sentence to save airtime
+// (21 bytes vs. ~60). Multi-byte fields are little endian.
+//
+//   offset size
+//      0    1  magic and schema version (TELEMETRY_FRAME_MAGIC)
+//      1    1  payload id, CRC-8 of the callsign
+//      2    2  message id
+//      4    3  time of day, seconds since midnight UTC
+//      7    3  latitude, signed, 90 degrees = 2^23
+//     10    3  longitude, signed, 180 degrees = 2^23
+//     13    2  altitude, meters (0..65535)
+//     15    1  satellites used
+//     16    1  internal temperature, Celsius (signed)
+//     17    1  battery voltage, 20 mV units
+//     18    1  pyro voltage, 50 mV units
+//     19    1  flags: TELEMETRY_FLAG_*, flight state in bits 4..5
+//     20    1  rate index of the next frame (see link_rate.h)
+//
+// Position and altitude are only valid with TELEMETRY_FLAG_FIX. The magic
+// byte is never a printable character, which tells the frame apart from a
+// UKHAS sentence.
+#define TELEMETRY_FRAME_VERSION     2
+#define TELEMETRY_FRAME_MAGIC       (0xA0 | TELEMETRY_FRAME_VERSION)
+#define TELEMETRY_FRAME_LENGTH      21
+
+#define TELEMETRY_FLAG_PYRO1        0x01
+#define TELEMETRY_FLAG_PYRO2        0x02
+#define TELEMETRY_FLAG_FIX          0x04
+#define TELEMETRY_STATE_SHIFT       4
+#define TELEMETRY_STATE_MASK        0x30
+
+namespace telemetry_frame {
+
+inline void put_u16(uint8_t *buf, uint16_t value) {
+    buf[0] = value;
+    buf[1] = value >> 8;
+}
+
+inline void put_u24(uint8_t *buf, uint32_t value) {
+    buf[0] = value;
+    buf[1] = value >> 8;
+    buf[2] = value >> 16;
+}
+
+inline uint16_t get_u16(const uint8_t *buf) {
+    return buf[0] | ((uint16_t)buf[1] << 8);
+}
+
+inline uint32_t get_u24(const uint8_t *buf) {
+    return buf[0] | ((uint16_t)buf[1] << 8) | ((uint32_t)buf[2] << 16);
+}
+
+// Sign extended
+inline int32_t get_s24(const uint8_t *buf) {
+    uint32_t value = get_u24(buf);
+    return (value & 0x800000UL) ? (int32_t)(value | 0xFF000000UL) : (int32_t)value;
+}
+
+// CRC-8 (polynomial 0x07, initial value 0xFF) of a zero terminated callsign
+inline uint8_t payload_id(const char *callsign, uint8_t max_length = 16) {
+    uint8_t crc = 0xFF;
+    for (uint8_t i = 0; i < max_length && callsign[i]; i++) {
+        crc ^= callsign[i];
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+}
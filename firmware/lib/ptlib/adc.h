@@ -2,6 +2,7 @@
 
 #include <libopencm3/stm32/adc.h>
 #include <libopencm3/stm32/syscfg.h>
+#include <libopencm3/stm32/dma.h>
 
 #include "rcc.h"
 
@@ -28,6 +29,18 @@ public:
         eUPWARD,
         eBACKWARD
     };
+
+    // Oversampling ratio (OVSR)
+    enum oversampling_t {
+        eOVS_2X   = 0,
+        eOVS_4X   = 1,
+        eOVS_8X   = 2,
+        eOVS_16X  = 3,
+        eOVS_32X  = 4,
+        eOVS_64X  = 5,
+        eOVS_128X = 6,
+        eOVS_256X = 7
+    };
 };
 
 template<uint32_t adc>
@@ -95,6 +108,105 @@ public:
         return adc_eoc(adc);
     }
 
+#ifdef STM32L0
+    // Accumulates 2^(ratio+1) conversions per result and shifts the sum
+    // right by 'shift' bits (e.g. 16x with shift 4 keeps a 12-bit result)
+    static void setOversampling(oversampling_t ratio, uint8_t shift) {
+        // CFGR2 can only be written while the ADC is disabled
+        adc_power_off(adc);
+        uint32_t reg = ADC_CFGR2(adc) & ~(ADC_CFGR2_OVSR_MASK | ADC_CFGR2_OVSS_MASK);
+        reg |= (ratio << ADC_CFGR2_OVSR_SHIFT) & ADC_CFGR2_OVSR_MASK;
+        reg |= (shift << ADC_CFGR2_OVSS_SHIFT) & ADC_CFGR2_OVSS_MASK;
+        ADC_CFGR2(adc) = reg | ADC_CFGR2_OVSE;
+        adc_power_on(adc);
+    }
+
+    static void disableOversampling() {
+        ADC_CFGR2(adc) &= ~ADC_CFGR2_OVSE;
+    }
+
+    // Stores each conversion of the channel sequence into 'buffer' via DMA.
+    // In circular mode the buffer is refreshed by every (triggered) scan,
+    // otherwise each scan has to be started with startScan().
+    static void beginDMA(volatile uint16_t *buffer, int length, bool circular = false) {
+        const uint8_t ch = PeriphTraits<adc>::dma_channel;
+
+        rcc_periph_clock_enable(RCC_DMA);
+
+        _dma_length = length;
+        _dma_circular = circular;
+
+        dma_channel_reset(DMA1, ch);
+        dma_set_channel_request(DMA1, ch, PeriphTraits<adc>::dma_request);
+        dma_set_peripheral_address(DMA1, ch, (uint32_t)&ADC_DR(adc));
+        dma_set_memory_address(DMA1, ch, (uint32_t)buffer);
+        dma_set_number_of_data(DMA1, ch, length);
+        dma_set_read_from_peripheral(DMA1, ch);
+        dma_enable_memory_increment_mode(DMA1, ch);
+        dma_set_peripheral_size(DMA1, ch, DMA_CCR_PSIZE_16BIT);
+        dma_set_memory_size(DMA1, ch, DMA_CCR_MSIZE_16BIT);
+        dma_set_priority(DMA1, ch, DMA_CCR_PL_LOW);
+        if (circular) {
+            dma_enable_circular_mode(DMA1, ch);
+            ADC_CFGR1(adc) |= ADC_CFGR1_DMACFG;
+        }
+        else {
+            ADC_CFGR1(adc) &= ~ADC_CFGR1_DMACFG;
+        }
+        ADC_CFGR1(adc) |= ADC_CFGR1_DMAEN;
+        dma_enable_channel(DMA1, ch);
+    }
+
+    // Starts one conversion of the whole channel sequence, returns immediately
+    static void startScan() {
+        const uint8_t ch = PeriphTraits<adc>::dma_channel;
+
+        if (!_dma_circular) {
+            // One-shot DMA stops after the last transfer, re-arm it
+            dma_disable_channel(DMA1, ch);
+            dma_clear_interrupt_flags(DMA1, ch, DMA_TCIF | DMA_GIF);
+            dma_set_number_of_data(DMA1, ch, _dma_length);
+            ADC_CFGR1(adc) &= ~ADC_CFGR1_DMAEN;
+            ADC_CFGR1(adc) |= ADC_CFGR1_DMAEN;
+            dma_enable_channel(DMA1, ch);
+        }
+        ADC_ISR(adc) = ADC_ISR_EOS | ADC_ISR_OVR;
+        startConversion();
+    }
+
+    // True once the last scan started with startScan() is in the buffer
+    static bool isScanComplete() {
+        return dma_get_interrupt_flag(DMA1, PeriphTraits<adc>::dma_channel, DMA_TCIF);
+    }
+
+    static bool isBusy() {
+        return (ADC_CR(adc) & ADC_CR_ADSTART) != 0;
+    }
+
+    // Position of a channel's result in the scan buffer
+    static int sequenceIndex(uint8_t channel) {
+        uint32_t selected = ADC_CHSELR(adc);
+        int index = __builtin_popcount(selected & ((1UL << channel) - 1));
+        if (ADC_CFGR1(adc) & ADC_CFGR1_SCANDIR) {
+            index = __builtin_popcount(selected) - 1 - index;
+        }
+        return index;
+    }
+
+    // Starts scans on the rising edge of a hardware trigger (EXTSEL),
+    // e.g. a timer TRGO, for continuous background sampling
+    static void setExternalTrigger(uint8_t extsel) {
+        uint32_t reg = ADC_CFGR1(adc) & ~(ADC_CFGR1_EXTSEL_MASK | ADC_CFGR1_EXTEN_MASK);
+        reg |= (extsel << ADC_CFGR1_EXTSEL_SHIFT) & ADC_CFGR1_EXTSEL_MASK;
+        reg |= (1 << ADC_CFGR1_EXTEN_SHIFT);
+        ADC_CFGR1(adc) = reg;
+    }
+
+    static void setSoftwareTrigger() {
+        ADC_CFGR1(adc) &= ~ADC_CFGR1_EXTEN_MASK;
+    }
+#endif
+
     static void enableVREFINT() {
         SYSCFG_CFGR3 |= SYSCFG_CFGR3_EN_VREFINT;
         // Wait until VREFINT becomes ready
@@ -103,4 +215,18 @@ public:
 
         ADC_CCR(adc) |= ADC_CCR_VREFEN;
     }
+
+#ifdef STM32L0
+private:
+    static int  _dma_length;
+    static bool _dma_circular;
+#endif
 };
+
+#ifdef STM32L0
+template<uint32_t adc>
+int ADC<adc>::_dma_length;
+
+template<uint32_t adc>
+bool ADC<adc>::_dma_circular;
+#endif
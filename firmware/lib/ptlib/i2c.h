@@ -1,21 +1,62 @@
 #pragma once
 
 #include <libopencm3/stm32/i2c.h>
+#include <libopencm3/cm3/cortex.h>
 
 #include "rcc.h"
 
 uint32_t millis(void);
 
+struct I2CRequest;
+
+typedef void (*i2c_callback_t)(I2CRequest *req);
+
+// A single I2C transaction: optional write phase followed by an optional 
+// read phase (with a repeated START in between). Requests are queued with
+// submit() and executed from the I2C interrupt.
+struct I2CRequest {
+    enum status_t {
+        eIDLE,
+        ePENDING,       // waiting in the queue
+        eBUSY,          // currently on the bus
+        eDONE,
+        eERROR,         // NACK or bus error
+        eTIMEOUT
+    };
+
+    uint8_t             address;
+    volatile uint8_t    status;
+    uint16_t            timeout;    // in milliseconds
+    const uint8_t       *tx_buf;
+    uint8_t             *rx_buf;
+    uint8_t             tx_len;
+    uint8_t             rx_len;
+    uint8_t             reg[2];     // inline TX data for register access
+    i2c_callback_t      callback;   // called from interrupt context
+    void                *user;
+    I2CRequest          *next;
+
+    I2CRequest() : status(eIDLE), next(0) {}
+
+    bool isPending() const { return status == ePENDING || status == eBUSY; }
+    bool isDone() const { return status == eDONE; }
+};
+
 class I2CBase {
 public:
     virtual bool read(int address, uint8_t *data, int length) = 0;
     virtual bool write(int address, const uint8_t *data, int length) = 0;
     virtual bool readwrite(int address, const uint8_t *data_w, int length_w, uint8_t *data_r, int length_r) = 0;
+
+    virtual bool submit(I2CRequest *req) = 0;
+    virtual bool wait(I2CRequest *req) = 0;
 };
 
 template<uint32_t i2c, typename Pin_sda, typename Pin_scl>
 class I2C : public RCC<i2c>, public NVIC<i2c>, public I2CBase {
 public:
+    static const uint16_t kDefaultTimeout = 10;    // ms
+
     static void begin() {
         // Setup clock source:
         // - I2C1: HSI@8Mhz (default) / SYSCLK
@@ -43,6 +84,8 @@ public:
 
         /* Enable I2C periph. */
         i2c_peripheral_enable(i2c);
+
+        _head = _tail = _current = 0;
     }
       
     static void shutdown() {
@@ -104,107 +147,212 @@ public:
 #endif
     }
 
-    static int check(uint16_t address) {
-        // Clear the STOP, NACK (and BERR?) flags
-        I2C_ICR(i2c) = I2C_ICR_NACKCF | I2C_ICR_STOPCF;
+    // Probes for a device at the given address, returns 0 if it ACKs
+    static int check(uint16_t address, uint16_t timeout = kDefaultTimeout) {
+        return transfer(address, 0, 0, 0, 0, timeout);
+    }
+
+    // Blocking transfer through the request queue, returns 0 on success
+    static int transfer(uint16_t address, const uint8_t *data_w, int length_w, 
+                        uint8_t *data_r, int length_r, uint16_t timeout = kDefaultTimeout) 
+    {
+        if (length_w > 255 || length_r > 255) return -1;
+
+        I2CRequest req;
+        req.address = address;
+        req.tx_buf = data_w;
+        req.tx_len = length_w;
+        req.rx_buf = data_r;
+        req.rx_len = length_r;
+        req.timeout = timeout;
+        req.callback = 0;
+        if (!enqueue(&req)) return -1;
+        return waitRequest(&req) ? 0 : -1;
+    }
+
+    // Appends a request to the queue and starts it if the bus is idle
+    static bool enqueue(I2CRequest *req) {
+        if (req->isPending()) return false;
 
-		i2c_set_7bit_address(i2c, address); // I2C_CR2_SADD   = address, CLEAR other fields
-		//i2c_set_read_transfer_dir(i2c);     // I2C_CR2_RD_WRN = 1
-        i2c_set_write_transfer_dir(i2c);     // I2C_CR2_RD_WRN = 0
-		i2c_set_bytes_to_transfer(i2c, 0);  // I2C_CR2_NBYTES = 0
-        i2c_enable_autoend(i2c);            // I2C_CR2_AUTOEND = 1
+        req->status = I2CRequest::ePENDING;
+        req->next = 0;
 
-        i2c_send_start(i2c);                // I2C_CR2_START   = 1
+        bool masked = cm_mask_interrupts(true);
+        if (_tail) _tail->next = req;
+        else _head = req;
+        _tail = req;
+        if (!_current) startNext();
+        cm_mask_interrupts(masked);
+        return true;
+    }
 
-        // Wait for STOP (no need to check TXIS)
-        while (!(I2C_ISR(i2c) & I2C_ISR_STOPF)) {}
+    // Waits for a request to finish, returns true if it completed successfully
+    static bool waitRequest(I2CRequest *req) {
+        while (req->isPending()) {
+            // idle wait
+            poll();
+        }
+        return req->status == I2CRequest::eDONE;
+    }
 
-        // Check for error (indicated by NACK)
-        if (I2C_ISR(i2c) & I2C_ISR_NACKF) {
-            return -1;
+    // Aborts the active request if it has exceeded its timeout.
+    // Should be called periodically from the main loop.
+    static void poll() {
+        bool masked = cm_mask_interrupts(true);
+        I2CRequest *req = _current;
+        if (req && (millis() - _start_time) > req->timeout) {
+            // Toggling PE resets the transfer state machine and releases the bus
+            i2c_peripheral_disable(i2c);
+            while (I2C_CR1(i2c) & I2C_CR1_PE) {}
+            i2c_peripheral_enable(i2c);
+            complete(I2CRequest::eTIMEOUT);
         }
+        cm_mask_interrupts(masked);
+    }
 
-        return 0;
+    static bool isIdle() {
+        return _current == 0;
     }
-    
-    static int write2(int address, const uint8_t *data, int length, bool repeated=false) {
-        //i2c_transfer7(i2c, address, (uint8_t *)data, length, 0, 0);
-
-        I2C_ICR(i2c) = I2C_ICR_NACKCF | I2C_ICR_STOPCF;
-
-		i2c_set_7bit_address(i2c, address);
-		i2c_set_write_transfer_dir(i2c);
-		i2c_set_bytes_to_transfer(i2c, length);
-		if (repeated) {
-			i2c_disable_autoend(i2c);
-		} else {
-			i2c_enable_autoend(i2c);
-		}
-		i2c_send_start(i2c);
-
-		while (length--) {
-            while (!i2c_transmit_int_status(i2c)) {
-                if (i2c_nack(i2c)) {
-                    if (repeated) {
-                        i2c_send_stop(i2c);
-                    }
-                    return -1;
-                }
+
+    // To be called from the I2C event/error interrupt handler
+    static void onInterrupt() {
+        uint32_t flags = I2C_ISR(i2c);
+        I2CRequest *req = _current;
+
+        if (!req) {
+            I2C_CR1(i2c) &= ~kInterruptMask;
+            return;
+        }
+
+        if (flags & (I2C_ISR_BERR | I2C_ISR_ARLO | I2C_ISR_OVR)) {
+            I2C_ICR(i2c) = I2C_ICR_BERRCF | I2C_ICR_ARLOCF | I2C_ICR_OVRCF;
+            i2c_peripheral_disable(i2c);
+            i2c_peripheral_enable(i2c);
+            complete(I2CRequest::eERROR);
+            return;
+        }
+        if (flags & I2C_ISR_NACKF) {
+            I2C_ICR(i2c) = I2C_ICR_NACKCF;
+            req->status = I2CRequest::eERROR;
+            if (!(I2C_CR2(i2c) & I2C_CR2_AUTOEND)) {
+                i2c_send_stop(i2c);
             }
-			i2c_send_data(i2c, *data++);
-		}
-		if (repeated) {
-            // AUTOEND is disabled, so wait for the TC flag
-			while (!i2c_transfer_complete(i2c)) {}
-		}
-        else {
-            //i2c_send_stop(i2c);
+            // finish on STOPF
         }
-        return 0;   // success
-    }
-    
-    static int read2(int address, uint8_t *data, int length, bool repeated=false) {
-        //i2c_transfer7(i2c, address, 0, 0, data, length);
-
-        I2C_ICR(i2c) = I2C_ICR_NACKCF | I2C_ICR_STOPCF;
-
-		/* Setting transfer properties */
-		i2c_set_7bit_address(i2c, address);
-		i2c_set_read_transfer_dir(i2c);
-		i2c_set_bytes_to_transfer(i2c, length);
-		/* start transfer */
-		i2c_send_start(i2c);
-		i2c_enable_autoend(i2c);
-
-		for (size_t i = 0; i < length; i++) {
-			while (!i2c_received_data(i2c)) {
-                if (i2c_nack(i2c)) return -1;
+        if (flags & I2C_ISR_RXNE) {
+            uint8_t data = i2c_get_data(i2c);
+            if (_rx_pos < req->rx_len) req->rx_buf[_rx_pos++] = data;
+        }
+        if (flags & I2C_ISR_TXIS) {
+            i2c_send_data(i2c, (_tx_pos < req->tx_len) ? req->tx_buf[_tx_pos++] : 0);
+        }
+        if (flags & I2C_ISR_TC) {
+            // Write phase done with AUTOEND off: continue with the read phase
+            if (req->status == I2CRequest::eBUSY && req->rx_len > 0) {
+                startPhase(req->address, true, req->rx_len);
+            }
+            else {
+                i2c_send_stop(i2c);
             }
-			data[i] = i2c_get_data(i2c);
-		}
-        return 0;   // success
+        }
+        if (flags & I2C_ISR_STOPF) {
+            I2C_ICR(i2c) = I2C_ICR_STOPCF;
+            complete((req->status == I2CRequest::eBUSY) ? I2CRequest::eDONE : req->status);
+        }
     }
 
     virtual bool read(int address, uint8_t *data, int length) {
-        return 0 == read2(address, data, length, false);
-        //i2c_transfer7(i2c, address, 0, 0, data, length);
-        //return true;
+        return 0 == transfer(address, 0, 0, data, length);
     }
     virtual bool write(int address, const uint8_t *data, int length) {
-        return 0 == write2(address, data, length, false);
-        //i2c_transfer7(i2c, address, (uint8_t *)data, length, 0, 0);
-        //return true;
+        return 0 == transfer(address, data, length, 0, 0);
     }
     virtual bool readwrite(int address, const uint8_t *data_w, int length_w, uint8_t *data_r, int length_r) {
-        if (0 == write2(address, data_w, length_w, true)) {
-            return 0 == read2(address, data_r, length_r, false);
+        return 0 == transfer(address, data_w, length_w, data_r, length_r);
+    }
+    virtual bool submit(I2CRequest *req) {
+        return enqueue(req);
+    }
+    virtual bool wait(I2CRequest *req) {
+        return waitRequest(req);
+    }
+
+private:
+    static const uint32_t kInterruptMask = I2C_CR1_TXIE | I2C_CR1_RXIE | I2C_CR1_TCIE 
+                                         | I2C_CR1_STOPIE | I2C_CR1_NACKIE | I2C_CR1_ERRIE;
+
+    static void startPhase(uint16_t address, bool read, int length) {
+        i2c_set_7bit_address(i2c, address);
+        if (read) i2c_set_read_transfer_dir(i2c);
+        else i2c_set_write_transfer_dir(i2c);
+        i2c_set_bytes_to_transfer(i2c, length);
+        // Keep the bus for a repeated START if a read phase follows the write
+        if (!read && _current->rx_len > 0) i2c_disable_autoend(i2c);
+        else i2c_enable_autoend(i2c);
+        i2c_send_start(i2c);
+    }
+
+    // Called with interrupts masked or from the ISR
+    static void startNext() {
+        I2CRequest *req = _head;
+        if (!req) {
+            I2C_CR1(i2c) &= ~kInterruptMask;
+            return;
+        }
+        _head = req->next;
+        if (!_head) _tail = 0;
+
+        _current = req;
+        _tx_pos = 0;
+        _rx_pos = 0;
+        _start_time = millis();
+        req->status = I2CRequest::eBUSY;
+
+        I2C_ICR(i2c) = I2C_ICR_NACKCF | I2C_ICR_STOPCF | I2C_ICR_BERRCF | I2C_ICR_ARLOCF | I2C_ICR_OVRCF;
+        I2C_CR1(i2c) |= kInterruptMask;
+
+        if (req->tx_len > 0 || req->rx_len == 0) {
+            startPhase(req->address, false, req->tx_len);
         }
-        return false;
-        //i2c_transfer7(i2c, address, (uint8_t *)data_w, length_w, data_r, length_r);
-        //return true;
+        else {
+            startPhase(req->address, true, req->rx_len);
+        }
+    }
+
+    static void complete(uint8_t status) {
+        I2CRequest *req = _current;
+        _current = 0;
+        req->status = status;
+        if (req->callback) req->callback(req);
+        startNext();
     }
+
+    static I2CRequest * volatile    _head;
+    static I2CRequest * volatile    _tail;
+    static I2CRequest * volatile    _current;
+    static uint8_t                  _tx_pos;
+    static uint8_t                  _rx_pos;
+    static uint32_t                 _start_time;
 };
 
+template<uint32_t i2c, typename Pin_sda, typename Pin_scl>
+I2CRequest * volatile I2C<i2c, Pin_sda, Pin_scl>::_head;
+
+template<uint32_t i2c, typename Pin_sda, typename Pin_scl>
+I2CRequest * volatile I2C<i2c, Pin_sda, Pin_scl>::_tail;
+
+template<uint32_t i2c, typename Pin_sda, typename Pin_scl>
+I2CRequest * volatile I2C<i2c, Pin_sda, Pin_scl>::_current;
+
+template<uint32_t i2c, typename Pin_sda, typename Pin_scl>
+uint8_t I2C<i2c, Pin_sda, Pin_scl>::_tx_pos;
+
+template<uint32_t i2c, typename Pin_sda, typename Pin_scl>
+uint8_t I2C<i2c, Pin_sda, Pin_scl>::_rx_pos;
+
+template<uint32_t i2c, typename Pin_sda, typename Pin_scl>
+uint32_t I2C<i2c, Pin_sda, Pin_scl>::_start_time;
+
 class I2CDeviceBase {
 public:
     I2CDeviceBase(I2CBase &bus, uint8_t slave_address) : bus(bus), slave_address(slave_address) {}
@@ -234,6 +382,45 @@ public:
         return true;
     }
 
+    // Queues a register burst read without waiting for it to complete
+    bool readRegisterAsync(I2CRequest &req, uint8_t address, uint8_t *value, uint8_t length, 
+                           i2c_callback_t callback = 0, void *user = 0) 
+    {
+        if (req.isPending()) return false;
+        req.address = slave_address;
+        req.reg[0] = address;
+        req.tx_buf = req.reg;
+        req.tx_len = 1;
+        req.rx_buf = value;
+        req.rx_len = length;
+        req.timeout = 10;
+        req.callback = callback;
+        req.user = user;
+        return bus.submit(&req);
+    }
+
+    // Queues a single register write without waiting for it to complete
+    bool writeRegisterAsync(I2CRequest &req, uint8_t address, uint8_t value, 
+                            i2c_callback_t callback = 0, void *user = 0) 
+    {
+        if (req.isPending()) return false;
+        req.address = slave_address;
+        req.reg[0] = address;
+        req.reg[1] = value;
+        req.tx_buf = req.reg;
+        req.tx_len = 2;
+        req.rx_buf = 0;
+        req.rx_len = 0;
+        req.timeout = 10;
+        req.callback = callback;
+        req.user = user;
+        return bus.submit(&req);
+    }
+
+    bool wait(I2CRequest &req) {
+        return bus.wait(&req);
+    }
+
 protected:
     I2CBase &bus;
     uint8_t slave_address;
@@ -2,6 +2,7 @@
 
 #include "gpio.h"
 #include "spi.h"
+#include "spibus.h"
 #include "i2c.h"
 #include "usart.h"
 #include "adc.h"
@@ -2,53 +2,111 @@
 
 #include <stdint.h>
 
+// Lock-free single producer, single consumer ring buffer.
+//
+// One side (e.g. an ISR) may only call the push* methods while the other side
+// (e.g. the main loop) may only call pop*/peek/consume, without any interrupt
+// masking. Head and tail are free-running counters, so all capacity slots are
+// usable and the fill level is simply (head - tail). Capacity must be a power of two.
 template<typename T, uint32_t capacity>
 class Queue {
+  static_assert(capacity > 0 && (capacity & (capacity - 1)) == 0, "Queue capacity must be a power of two");
+  static const uint32_t mask = capacity - 1;
+
 public:
-  Queue() : _size(0), _head(0) {} 
-  
+  Queue() : _head(0), _tail(0) {}
+
+  // Consumer side: discard everything queued so far
   void clear() {
-    _size = 0;
-    _head = 0;
+    store_release(_tail, load_acquire(_head));
   }
-  
+
+  // Producer side
   bool push(T item) {
-    if (_size < capacity) {
-      uint32_t tail = _head + _size;
-      if (tail >= capacity) tail -= capacity;
-      _buffer[tail] = item;
-      _size++;      
-      return true;
+    uint32_t head = _head;
+    if (head - load_acquire(_tail) >= capacity) return false;
+    _buffer[head & mask] = item;
+    store_release(_head, head + 1);
+    return true;
+  }
+
+  // Producer side: push up to count items, returns the number actually pushed
+  uint32_t push_n(const T *items, uint32_t count) {
+    uint32_t head = _head;
+    uint32_t space = capacity - (head - load_acquire(_tail));
+    if (count > space) count = space;
+    for (uint32_t i = 0; i < count; i++) {
+      _buffer[(head + i) & mask] = items[i];
     }
-    return false;
+    store_release(_head, head + count);
+    return count;
   }
-  
+
+  // Consumer side
   bool pop(T &item) {
-    if (_size > 0) {
-      item = _buffer[_head];
-      _head++;
-      if (_head == capacity) _head = 0;
-      _size--;
-      return true;
+    uint32_t tail = _tail;
+    if (load_acquire(_head) == tail) return false;
+    item = _buffer[tail & mask];
+    store_release(_tail, tail + 1);
+    return true;
+  }
+
+  // Consumer side: pop up to count items, returns the number actually popped
+  uint32_t pop_n(T *items, uint32_t count) {
+    uint32_t tail = _tail;
+    uint32_t used = load_acquire(_head) - tail;
+    if (count > used) count = used;
+    for (uint32_t i = 0; i < count; i++) {
+      items[i] = _buffer[(tail + i) & mask];
     }
-    return false;
+    store_release(_tail, tail + count);
+    return count;
+  }
+
+  // Consumer side: zero-copy access to the queued items. Returns the number of
+  // items stored contiguously from the current read position (up to the end of
+  // the buffer) and points data at the first one. Release them with consume().
+  uint32_t peek_contiguous(const T * &data) {
+    uint32_t tail = _tail;
+    uint32_t used = load_acquire(_head) - tail;
+    uint32_t to_end = capacity - (tail & mask);
+    data = &_buffer[tail & mask];
+    return (used < to_end) ? used : to_end;
   }
-  
-  uint32_t size() {
-    return _size;
+
+  // Consumer side: release count items previously obtained by peek_contiguous()
+  void consume(uint32_t count) {
+    store_release(_tail, _tail + count);
+  }
+
+  uint32_t size() const {
+    return load_acquire(_head) - load_acquire(_tail);
+  }
+
+  uint32_t free() const {
+    return capacity - size();
   }
 
-  bool empty() {
-    return (_size == 0);
+  bool empty() const {
+    return (size() == 0);
   }
 
-  bool full() {
-    return (_size == capacity);
+  bool full() const {
+    return (size() >= capacity);
   }
-  
+
 private:
-  T         _buffer[capacity];
-  uint32_t  _size;
-  uint32_t  _head;
-};
+  // The other side's index is written from another context. Acquire/release
+  // ordering keeps buffer accesses from being moved across the index update
+  // (a single DMB on Cortex-M0+, and correct on a multi-core host as well).
+  static uint32_t load_acquire(const volatile uint32_t &x) {
+    return __atomic_load_n(&x, __ATOMIC_ACQUIRE);
+  }
+  static void store_release(volatile uint32_t &x, uint32_t value) {
+    __atomic_store_n(&x, value, __ATOMIC_RELEASE);
+  }
 
+  T                 _buffer[capacity];
+  volatile uint32_t _head;    // written by the producer only
+  volatile uint32_t _tail;    // written by the consumer only
+};
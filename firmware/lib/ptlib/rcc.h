@@ -39,16 +39,30 @@ public:
 
 template<> struct PeriphTraits<ADC1> { 
     const static rcc_periph_clken clock = RCC_ADC1;
+#if defined(STM32L0)
+    const static uint8_t dma_channel = 1;
+    const static uint8_t dma_request = 0;
+#endif
 };
 
 template<> struct PeriphTraits<USART1> { 
     const static uint8_t irq = NVIC_USART1_IRQ; 
     const static rcc_periph_clken clock = RCC_USART1;
+#if defined(STM32L0)
+    const static uint8_t dma_rx_channel = 5;
+    const static uint8_t dma_rx_request = 3;
+    const static uint8_t dma_irq        = NVIC_DMA1_CHANNEL4_7_IRQ;
+#endif
 };
 
 template<> struct PeriphTraits<USART2> { 
     const static rcc_periph_clken clock = RCC_USART2;
     const static uint8_t irq = NVIC_USART2_IRQ; 
+#if defined(STM32L0)
+    const static uint8_t dma_rx_channel = 6;
+    const static uint8_t dma_rx_request = 4;
+    const static uint8_t dma_irq        = NVIC_DMA1_CHANNEL4_7_IRQ;
+#endif
 };
 
 template<> struct PeriphTraits<I2C1> { 
@@ -64,11 +78,23 @@ template<> struct PeriphTraits<I2C2> {
 template<> struct PeriphTraits<SPI1> { 
     const static uint8_t irq = NVIC_SPI1_IRQ; 
     const static rcc_periph_clken clock = RCC_SPI1;
+#if defined(STM32L0)
+    const static uint8_t dma_rx_channel = 2;
+    const static uint8_t dma_tx_channel = 3;
+    const static uint8_t dma_request    = 1;
+    const static uint8_t dma_irq        = NVIC_DMA1_CHANNEL2_3_IRQ;
+#endif
 };
 
 template<> struct PeriphTraits<SPI2> { 
     const static uint8_t irq = NVIC_SPI2_IRQ; 
     const static rcc_periph_clken clock = RCC_SPI2;
+#if defined(STM32L0)
+    const static uint8_t dma_rx_channel = 4;
+    const static uint8_t dma_tx_channel = 5;
+    const static uint8_t dma_request    = 2;
+    const static uint8_t dma_irq        = NVIC_DMA1_CHANNEL4_7_IRQ;
+#endif
 };
 
 template<> struct PeriphTraits<GPIOA> { 
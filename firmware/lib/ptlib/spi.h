@@ -1,9 +1,12 @@
 #pragma once
 
 #include <libopencm3/stm32/spi.h>
+#include <libopencm3/stm32/dma.h>
 
 #include "rcc.h"
 
+typedef void (*spi_callback_t)(void);
+
 template<uint32_t spi, typename Pin_mosi, typename Pin_miso, typename Pin_sclk>
 class SPI : public RCC<spi> {
 public:
@@ -124,8 +127,140 @@ public:
     static bool is_busy() {
 	    return (SPI_SR(spi) & SPI_SR_BSY);
     }
+
+#if defined(STM32L0)
+    // Transfers shorter than this are not worth the DMA setup overhead
+    static const int kDMAMinLength = 8;
+
+    static void beginDMA() {
+        rcc_periph_clock_enable(RCC_DMA);
+        nvic_enable_irq(PeriphTraits<spi>::dma_irq);
+        _dma_enabled = true;
+    }
+
+    // Starts a DMA transfer and returns immediately. Either buffer may be 0
+    // (TX-only sends zeros, RX-only discards received data). The callback is 
+    // invoked from the DMA interrupt when the last byte has been received.
+    static void transferAsync(const uint8_t *tx_buffer, uint8_t *rx_buffer, int length, spi_callback_t callback = 0) {
+        const uint8_t ch_rx = PeriphTraits<spi>::dma_rx_channel;
+        const uint8_t ch_tx = PeriphTraits<spi>::dma_tx_channel;
+
+        _dma_busy = true;
+        _dma_callback = callback;
+        _dma_dummy_tx = 0;
+
+        // Flush any stale received data
+        while (SPI_SR(spi) & SPI_SR_RXNE) {
+            (void)SPI_DR(spi);
+        }
+
+        dma_channel_reset(DMA1, ch_rx);
+        dma_set_channel_request(DMA1, ch_rx, PeriphTraits<spi>::dma_request);
+        dma_set_peripheral_address(DMA1, ch_rx, (uint32_t)&SPI_DR(spi));
+        dma_set_read_from_peripheral(DMA1, ch_rx);
+        if (rx_buffer) {
+            dma_set_memory_address(DMA1, ch_rx, (uint32_t)rx_buffer);
+            dma_enable_memory_increment_mode(DMA1, ch_rx);
+        }
+        else {
+            dma_set_memory_address(DMA1, ch_rx, (uint32_t)&_dma_dummy_rx);
+        }
+        dma_set_number_of_data(DMA1, ch_rx, length);
+        dma_set_peripheral_size(DMA1, ch_rx, DMA_CCR_PSIZE_8BIT);
+        dma_set_memory_size(DMA1, ch_rx, DMA_CCR_MSIZE_8BIT);
+        dma_set_priority(DMA1, ch_rx, DMA_CCR_PL_VERY_HIGH);
+        dma_enable_transfer_complete_interrupt(DMA1, ch_rx);
+
+        dma_channel_reset(DMA1, ch_tx);
+        dma_set_channel_request(DMA1, ch_tx, PeriphTraits<spi>::dma_request);
+        dma_set_peripheral_address(DMA1, ch_tx, (uint32_t)&SPI_DR(spi));
+        dma_set_read_from_memory(DMA1, ch_tx);
+        if (tx_buffer) {
+            dma_set_memory_address(DMA1, ch_tx, (uint32_t)tx_buffer);
+            dma_enable_memory_increment_mode(DMA1, ch_tx);
+        }
+        else {
+            dma_set_memory_address(DMA1, ch_tx, (uint32_t)&_dma_dummy_tx);
+        }
+        dma_set_number_of_data(DMA1, ch_tx, length);
+        dma_set_peripheral_size(DMA1, ch_tx, DMA_CCR_PSIZE_8BIT);
+        dma_set_memory_size(DMA1, ch_tx, DMA_CCR_MSIZE_8BIT);
+        dma_set_priority(DMA1, ch_tx, DMA_CCR_PL_HIGH);
+
+        // RX must be armed before TX starts shifting data out
+        dma_enable_channel(DMA1, ch_rx);
+        dma_enable_channel(DMA1, ch_tx);
+        spi_enable_rx_dma(spi);
+        spi_enable_tx_dma(spi);
+    }
+
+    // Blocking bulk transfer, uses DMA for long transfers when available
+    static void transfer(const uint8_t *tx_buffer, uint8_t *rx_buffer, int length) {
+        if (_dma_enabled && length >= kDMAMinLength) {
+            transferAsync(tx_buffer, rx_buffer, length);
+            waitDMA();
+            return;
+        }
+        while (length > 0) {
+            uint8_t response = write(tx_buffer ? *tx_buffer++ : 0);
+            if (rx_buffer) *rx_buffer++ = response;
+            length--;
+        }
+    }
+
+    static bool isDMABusy() {
+        return _dma_busy;
+    }
+
+    static void waitDMA() {
+        while (_dma_busy) {
+            // idle wait
+        }
+    }
+
+    // To be called from the DMA channel interrupt handler
+    static void onDMAComplete() {
+        const uint8_t ch_rx = PeriphTraits<spi>::dma_rx_channel;
+        const uint8_t ch_tx = PeriphTraits<spi>::dma_tx_channel;
+
+        if (!dma_get_interrupt_flag(DMA1, ch_rx, DMA_TCIF)) return;
+        dma_clear_interrupt_flags(DMA1, ch_rx, DMA_TCIF | DMA_GIF);
+
+        spi_disable_tx_dma(spi);
+        spi_disable_rx_dma(spi);
+        dma_disable_channel(DMA1, ch_tx);
+        dma_disable_channel(DMA1, ch_rx);
+
+        _dma_busy = false;
+        if (_dma_callback) _dma_callback();
+    }
+
+private:
+    static bool                 _dma_enabled;
+    static volatile bool        _dma_busy;
+    static spi_callback_t       _dma_callback;
+    static uint8_t              _dma_dummy_tx;
+    static uint8_t              _dma_dummy_rx;
+#endif
 };
 
+#if defined(STM32L0)
+template<uint32_t spi, typename Pin_mosi, typename Pin_miso, typename Pin_sclk>
+bool SPI<spi, Pin_mosi, Pin_miso, Pin_sclk>::_dma_enabled;
+
+template<uint32_t spi, typename Pin_mosi, typename Pin_miso, typename Pin_sclk>
+volatile bool SPI<spi, Pin_mosi, Pin_miso, Pin_sclk>::_dma_busy;
+
+template<uint32_t spi, typename Pin_mosi, typename Pin_miso, typename Pin_sclk>
+spi_callback_t SPI<spi, Pin_mosi, Pin_miso, Pin_sclk>::_dma_callback;
+
+template<uint32_t spi, typename Pin_mosi, typename Pin_miso, typename Pin_sclk>
+uint8_t SPI<spi, Pin_mosi, Pin_miso, Pin_sclk>::_dma_dummy_tx;
+
+template<uint32_t spi, typename Pin_mosi, typename Pin_miso, typename Pin_sclk>
+uint8_t SPI<spi, Pin_mosi, Pin_miso, Pin_sclk>::_dma_dummy_rx;
+#endif
+
 class SPIVirtualBase {
 public:
     virtual uint8_t write(uint8_t value);
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <stdint.h>
+#include <libopencm3/cm3/cortex.h>
+
+// Bus settings of one device, applied whenever the device takes the bus
+struct SPIDeviceConfig {
+    uint32_t    frequency;
+    uint8_t     mode;
+};
+
+struct SPIBusRequest;
+
+typedef void (*spi_request_callback_t)(SPIBusRequest *req);
+
+// Deferred bus access, e.g. from an interrupt that found the bus in use.
+// The callback runs with the bus acquired for the device, as soon as the
+// current owner releases it, and may only access that device.
+struct SPIBusRequest {
+    const SPIDeviceConfig   *device;
+    spi_request_callback_t  callback;
+    volatile bool           pending;
+    SPIBusRequest           *next;
+};
+
+// Arbiter for several devices (each with its own chip select) on one SPI bus.
+//
+// A device holds the bus from chip select to deselect, nested acquires by the
+// same device are allowed. Transactions are short (a register access, a flash
+// command or page), so devices interleave at transaction boundaries: a long
+// flash operation split into pages lets queued requests run between pages.
+template<typename SPI_>
+class SPIBus {
+public:
+    // Takes the bus for a device, returns false if another device holds it
+    // (only possible in an interrupt that preempted a transaction)
+    static bool tryAcquire(const SPIDeviceConfig &device) {
+        bool masked = cm_mask_interrupts(true);
+        bool ok = (_owner == 0 || _owner == &device);
+        if (ok) {
+            _owner = &device;
+            _depth++;
+        }
+        cm_mask_interrupts(masked);
+        if (ok && _depth == 1) configure(device);
+        return ok;
+    }
+
+    // Main context only. The bus is never held across a return to the main
+    // loop, so this doesn't wait in practice.
+    static void acquire(const SPIDeviceConfig &device) {
+        while (!tryAcquire(device)) {
+            // idle wait
+        }
+    }
+
+    // Releases the bus and runs the requests queued meanwhile
+    static void release() {
+        bool masked = cm_mask_interrupts(true);
+        if (--_depth > 0) {
+            cm_mask_interrupts(masked);
+            return;
+        }
+        _owner = 0;
+        cm_mask_interrupts(masked);
+        runQueued();
+    }
+
+    // Runs the request right away if the bus is free, otherwise queues it
+    static void submit(SPIBusRequest *req) {
+        req->pending = true;
+        req->next = 0;
+
+        bool masked = cm_mask_interrupts(true);
+        if (_tail) _tail->next = req;
+        else _head = req;
+        _tail = req;
+        bool idle = (_owner == 0);
+        cm_mask_interrupts(masked);
+
+        if (idle) runQueued();
+    }
+
+private:
+    static void configure(const SPIDeviceConfig &device) {
+        if (_configured == &device) return;
+        while (SPI_::is_busy()) {
+            // idle wait
+        }
+        SPI_::format(8, device.mode);
+        SPI_::frequency(device.frequency);
+        _configured = &device;
+    }
+
+    static void runQueued() {
+        while (true) {
+            bool masked = cm_mask_interrupts(true);
+            SPIBusRequest *req = (_owner == 0) ? _head : 0;
+            if (req) {
+                _head = req->next;
+                if (!_head) _tail = 0;
+                _owner = req->device;
+                _depth = 1;
+            }
+            cm_mask_interrupts(masked);
+            if (!req) return;
+
+            configure(*req->device);
+            req->callback(req);
+            req->pending = false;
+
+            masked = cm_mask_interrupts(true);
+            _depth = 0;
+            _owner = 0;
+            cm_mask_interrupts(masked);
+        }
+    }
+
+    static const SPIDeviceConfig * volatile _owner;
+    static volatile uint8_t                 _depth;
+    static const SPIDeviceConfig            *_configured;
+    static SPIBusRequest                    *_head;
+    static SPIBusRequest                    *_tail;
+};
+
+template<typename SPI_>
+const SPIDeviceConfig * volatile SPIBus<SPI_>::_owner;
+
+template<typename SPI_>
+volatile uint8_t SPIBus<SPI_>::_depth;
+
+template<typename SPI_>
+const SPIDeviceConfig * SPIBus<SPI_>::_configured;
+
+template<typename SPI_>
+SPIBusRequest * SPIBus<SPI_>::_head;
+
+template<typename SPI_>
+SPIBusRequest * SPIBus<SPI_>::_tail;
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <libopencm3/stm32/usart.h>
+#include <libopencm3/stm32/dma.h>
 
 #include "rcc.h"
 
@@ -55,6 +56,73 @@ public:
         return c;
     }
 
+#if defined(STM32L0)
+    // Let the RX interrupt wake the MCU from STOP mode (requires HSI16 kernel clock)
+    static void enableWakeupFromStop() {
+        if (usart == USART1) {
+            RCC_CCIPR &= ~(RCC_CCIPR_USART1SEL_MASK << RCC_CCIPR_USART1SEL_SHIFT);
+            RCC_CCIPR |= (RCC_CCIPR_USART1SEL_HSI16 << RCC_CCIPR_USART1SEL_SHIFT);
+        }
+        else if (usart == USART2) {
+            RCC_CCIPR &= ~(RCC_CCIPR_USART2SEL_MASK << RCC_CCIPR_USART2SEL_SHIFT);
+            RCC_CCIPR |= (RCC_CCIPR_USART2SEL_HSI16 << RCC_CCIPR_USART2SEL_SHIFT);
+        }
+        USART_CR1(usart) |= USART_CR1_UESM;
+
+        if (USART_CR3(usart) & USART_CR3_DMAR) {
+            // RXNE is serviced by DMA, so wake up on the start bit instead.
+            // WUS can only be changed while the USART is disabled.
+            usart_disable(usart);
+            USART_CR3(usart) = (USART_CR3(usart) & ~USART_CR3_WUS_MASK) | USART_CR3_WUS_START_BIT;
+            usart_enable(usart);
+            USART_CR3(usart) |= USART_CR3_WUFIE;
+        }
+    }
+
+    // Receives continuously into a circular buffer through DMA. The DMA
+    // transfer complete and the USART IDLE/error interrupts are enabled,
+    // the handlers must clear them (see clearRXEvents()).
+    static void beginRXDMA(volatile uint8_t *buffer, uint16_t size) {
+        const uint8_t ch = PeriphTraits<usart>::dma_rx_channel;
+
+        rcc_periph_clock_enable(RCC_DMA);
+
+        usart_disable_rx_interrupt(usart);
+
+        dma_channel_reset(DMA1, ch);
+        dma_set_channel_request(DMA1, ch, PeriphTraits<usart>::dma_rx_request);
+        dma_set_peripheral_address(DMA1, ch, (uint32_t)&USART_RDR(usart));
+        dma_set_memory_address(DMA1, ch, (uint32_t)buffer);
+        dma_set_number_of_data(DMA1, ch, size);
+        dma_set_read_from_peripheral(DMA1, ch);
+        dma_enable_memory_increment_mode(DMA1, ch);
+        dma_set_peripheral_size(DMA1, ch, DMA_CCR_PSIZE_8BIT);
+        dma_set_memory_size(DMA1, ch, DMA_CCR_MSIZE_8BIT);
+        dma_set_priority(DMA1, ch, DMA_CCR_PL_MEDIUM);
+        dma_enable_circular_mode(DMA1, ch);
+        dma_enable_transfer_complete_interrupt(DMA1, ch);
+        dma_enable_channel(DMA1, ch);
+
+        USART_ICR(usart) = USART_ICR_IDLECF | USART_ICR_ORECF | USART_ICR_FECF | USART_ICR_NCF;
+        USART_CR3(usart) |= USART_CR3_DMAR | USART_CR3_EIE;
+        USART_CR1(usart) |= USART_CR1_IDLEIE;
+
+        nvic_enable_irq(PeriphTraits<usart>::dma_irq);
+    }
+
+    // Number of bytes DMA still has to write before wrapping around
+    static uint16_t rxDMARemaining() {
+        return dma_get_number_of_data(DMA1, PeriphTraits<usart>::dma_rx_channel);
+    }
+
+    // Clears the IDLE, error and wakeup flags, returns true on a receive overrun
+    static bool clearRXEvents() {
+        uint32_t flags = USART_ISR(usart);
+        USART_ICR(usart) = flags & (USART_ICR_IDLECF | USART_ICR_ORECF | USART_ICR_FECF | USART_ICR_NCF | USART_ICR_WUCF);
+        return (flags & USART_ISR_ORE) != 0;
+    }
+#endif
+
     static void enableRXInterrupt() {
         usart_enable_rx_interrupt(usart);
     }
@@ -14,7 +14,12 @@
 #include "display.h"
 #include "telemetry.h"
 
+#include <telemetry_frame.h>
+#include <link_rate.h>
+
 RemoteData  gLastPacket;
+uint8_t     gRate;              // Rate index the receiver is set to
+uint32_t    gLastHeard;         // millis() of the last binary frame
 
 RH_RF95     lora(LORA_CS_PIN);
 uint8_t     gLastPacketRaw[LORA_MAX_MESSAGE_LEN + 6];
@@ -63,8 +68,8 @@ void lora_setup() {
     }
     // Defaults after init are 434.0MHz, 13dBm, Bw = 125 kHz, Cr = 4/5, Sf = 128chips/symbol, CRC on
     lora.setModemConfig(MODEM_MODE);
-    lora.setSpreadingFactor(10);
     lora.setCodingRate4(8);
+    lora_set_rate(0);
     lora.setFrequency(FREQUENCY_MHZ);	
 	
 	char str[40];
@@ -99,6 +104,12 @@ void loop() {
             gFields.update_remote_position(gLastPacket.lat, gLastPacket.lng, gLastPacket.alt, gLastPacket.time);
         }
     }
+
+    // Without frames the payload falls back to the default rate as well
+    if (gRate != 0 && millis() - gLastHeard > (LINK_REPORT_TIMEOUT + 2) * 1000UL * lora::rate_schedule[gRate].interval_s) {
+        Serial.println("Link lost, default rate");
+        lora_set_rate(0);
+    }
 	
 #ifdef WITH_DISPLAY
     if (newGPSData) {
@@ -171,9 +182,25 @@ bool lora_receive() {
     uint8_t *buf = gLastPacketRaw;
     uint8_t len = LORA_MAX_MESSAGE_LEN;
     if (lora.recv(buf, &len)) {
-        // Add zero termination to make a valid C string
         char *str = (char *)buf;
-        str[len] = '\0';
+        if (len > 0 && buf[0] == TELEMETRY_FRAME_MAGIC) {
+            // Binary frame, turn it into a UKHAS sentence for the serial
+            // output and the display
+            if (!gLastPacket.parse_binary(buf, len)) {
+                Serial.println("Bad binary frame");
+                return false;
+            }
+            // The payload listens only briefly after its frame
+            lora_link_report();
+            if (!gLastPacket.build_string(str, LORA_MAX_MESSAGE_LEN + 1)) {
+                Serial.println("Bad binary frame");
+                return false;
+            }
+        }
+        else {
+            // Add zero termination to make a valid C string
+            str[len] = '\0';
+        }
           
         // Calculate UKHAS checksum
         char chksum_str[8];
@@ -191,6 +218,34 @@ bool lora_receive() {
     return false;
 }
 
+void lora_set_rate(uint8_t rate) {
+    if (rate >= lora::rate_count) rate = 0;
+    lora.setSpreadingFactor(lora::rate_schedule[rate].sf);
+    lora.setSignalBandwidth(500000L / lora::rate_schedule[rate].bw_div);
+    gRate = rate;
+}
+
+// Tells the payload how well its last frame came through and follows the
+// rate it announced
+void lora_link_report() {
+    uint8_t report[LINK_REPORT_LENGTH];
+    report[0] = LINK_REPORT_MAGIC;
+    report[1] = gLastPacket.payload_id;
+    telemetry_frame::put_u16(report + 2, gLastPacket.msg_id);
+    report[4] = gRate;
+    report[5] = lora.lastSNR();
+    report[6] = lora.lastRssi();
+    lora.send(report, sizeof(report));
+    lora.waitPacketSent();
+
+    gLastHeard = millis();
+    if (gLastPacket.next_rate != gRate) {
+        lora_set_rate(gLastPacket.next_rate);
+        Serial.print("Rate "); Serial.print(gRate, DEC);
+        Serial.print(" SF"); Serial.println(lora::rate_schedule[gRate].sf, DEC);
+    }
+}
+
 static uint16_t crc_xmodem_update(uint16_t crc, uint8_t data) {
     int i;
     crc = crc ^ ((uint16_t)data << 8);
@@ -2,6 +2,9 @@
 
 #include <string.h>
 #include <stdlib.h>
+#include <stdio.h>
+
+#include <telemetry_frame.h>
 
 void RemoteData::parse_string(const char *buf) {
     uint8_t field_idx = 0;
@@ -31,8 +34,13 @@ void RemoteData::parse_string(const char *buf) {
             char field[11];
             field[10] = '\0';   // Safeguard
             strncpy(field, buf, 10);
+            field[f_len] = '\0';
 
             switch (field_idx) {
+            case 0: /* CALLSIGN (a placeholder for binary frames starts with #) */
+                if (field[0] != '#') 
+                    strcpy(callsign, field);
+                break;
             case 2: /* TIMESTAMP (hhmmss) */
                 time.second = strtoul(field + 4, NULL, 10);
                 field[4] = '\0';
@@ -76,3 +84,87 @@ void RemoteData::parse_string(const char *buf) {
         field_idx++;
     }
 }
+
+bool RemoteData::parse_binary(const uint8_t *buf, uint8_t len) {
+    using namespace telemetry_frame;
+
+    if (len < TELEMETRY_FRAME_LENGTH || buf[0] != TELEMETRY_FRAME_MAGIC) 
+        return false;
+
+    payload_id = buf[1];
+    msg_id = get_u16(buf + 2);
+
+    uint32_t time_of_day = get_u24(buf + 4);
+    time.hour = time_of_day / 3600;
+    time.minute = (time_of_day / 60) % 60;
+    time.second = time_of_day % 60;
+
+    flags = buf[19];
+    if (flags & TELEMETRY_FLAG_FIX) {
+        // Keep the last valid position otherwise, as with empty UKHAS fields
+        lat = get_s24(buf + 7) * (90.0f / 8388608);
+        lng = get_s24(buf + 10) * (180.0f / 8388608);
+        alt = get_u16(buf + 13);
+    }
+
+    n_sats = buf[15];
+    temperature_ext = (int8_t)buf[16];
+    battery_voltage = buf[17] * 20;
+    pyro_voltage = buf[18] * 50;
+    switch_state = flags & (TELEMETRY_FLAG_PYRO1 | TELEMETRY_FLAG_PYRO2);
+    next_rate = buf[20];
+    return true;
+}
+
+// Prints degrees with 5 decimals, without relying on float printf support
+static void format_degrees(char *buf, float value) {
+    long fixed = (long)(value * 100000 + ((value >= 0) ? 0.5f : -0.5f));
+    unsigned long magnitude = (fixed < 0) ? -fixed : fixed;
+    sprintf(buf, "%s%lu.%05lu", (fixed < 0) ? "-" : "", magnitude / 100000, magnitude % 100000);
+}
+
+bool RemoteData::build_string(char *buf, uint8_t buf_len) {
+    char callsign_str[16];
+    char lat_str[12];
+    char lng_str[12];
+    char alt_str[8];
+    char status_str[4];
+
+    // The frame only has the CRC of the callsign, which is known from
+    // the UKHAS sentences sent in between
+    if (callsign[0] && payload_id == telemetry_frame::payload_id(callsign, sizeof(callsign))) {
+        strncpy(callsign_str, callsign, sizeof(callsign_str) - 1);
+        callsign_str[sizeof(callsign_str) - 1] = '\0';
+    }
+    else {
+        sprintf(callsign_str, "#%02X", payload_id);
+    }
+
+    if (flags & TELEMETRY_FLAG_FIX) {
+        format_degrees(lat_str, lat);
+        format_degrees(lng_str, lng);
+        sprintf(alt_str, "%u", (uint16_t)alt);
+    }
+    else {
+        lat_str[0] = '\0';
+        lng_str[0] = '\0';
+        alt_str[0] = '\0';
+    }
+
+    uint8_t tmp = 0;
+    if (switch_state & 1) status_str[tmp++] = '1';
+    if (switch_state & 2) status_str[tmp++] = '2';
+    if (tmp == 0) status_str[tmp++] = '-';
+    status_str[tmp] = '\0';
+
+    // Same fields as the UKHAS sentence of tiny-sky
+    int buf_req = snprintf(buf, buf_len, "%s,%u,%02d%02d%02d,%s,%s,%s,%d,%d,%d,%d,%s", 
+        callsign_str, msg_id,
+        time.hour, time.minute, time.second,
+        lat_str, lng_str, alt_str, n_sats,
+        temperature_ext, 
+        (pyro_voltage + 5) / 10, (battery_voltage + 5) / 10,
+        status_str
+    );
+    return (buf_req < buf_len);
+}
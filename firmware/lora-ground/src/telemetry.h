@@ -6,7 +6,7 @@
 
 struct RemoteData {
 public:
-    //char     callsign[8];
+    char     callsign[16];      // From the last UKHAS sentence
     uint16_t msg_id;            // Message identifier
     
     TimeHMS  time;              // Timestamp (hour/minute/second) of position
@@ -17,8 +17,19 @@ public:
     int8_t   temperature_ext;   // External temperature, Celsius
     uint8_t  switch_state;      // Bit field of switch states
 
+    // Binary frames only
+    uint8_t  payload_id;        // CRC-8 of the callsign
+    uint8_t  flags;             // TELEMETRY_FLAG_* and flight state
+    uint16_t battery_voltage;   // millivolts
+    uint16_t pyro_voltage;      // millivolts
+    uint8_t  next_rate;         // Announced rate index (link_rate.h)
+
     uint16_t msg_recv;  // Number of received messages
     int8_t   rssi_last; // RSSI of the last rx message
 
     void parse_string(const char *buf);
+    // Decodes a binary frame (see telemetry_frame.h), returns false if it is not one
+    bool parse_binary(const uint8_t *buf, uint8_t len);
+    // Formats the last binary frame as a UKHAS sentence
+    bool build_string(char *buf, uint8_t buf_len);
 };
@@ -7,6 +7,7 @@
 #include <TimeLib.h>
 #include <TinyGPS++.h>
 #include <RH_RF95.h>
+#include <airtime.h>
 //#include <Servo.h>
 #include <avr/wdt.h>
 
@@ -21,6 +22,13 @@
 TinyGPSPlus gps;
 RH_RF95     lora(LORA_CS_PIN);
 Status      status;
+
+lora::AirtimeBudget airtime_budget(DUTY_CYCLE_PERMILLE, 60000);
+
+// The longest message (plus the RadioHead header) must fit in our timeslot
+#define MAX_MESSAGE_LENGTH  79
+static_assert(lora::time_on_air_ms(MAX_MESSAGE_LENGTH + RH_RF95_HEADER_LEN, LORA_SF, LORA_BW_DIV, LORA_CR) 
+    <= SLOT_LENGTH * 1000UL, "Message doesn't fit in the timeslot, use a longer slot or a faster modem mode");
 //Servo		servo1;
 //Servo		servo2;
 
@@ -134,7 +142,7 @@ void lora_setup()
     // Defaults after init are 434.0MHz, 13dBm
     // Bw = 125 kHz, Cr = 4/5, Sf = 128chips/symbol, CRC on
     lora.setModemConfig(MODEM_MODE);
-    lora.setSpreadingFactor(11);
+    lora.setSpreadingFactor(LORA_SF);
     lora.setFrequency(FREQUENCY_MHZ);
     lora.setTxPower(TX_POWER_DBM);	
 }
@@ -219,13 +227,23 @@ bool timeslot_go() {
 
 /// Constructs payload message and transmits it via radio
 void lora_transmit() {
-    char    tx_buf[80];    // Temporary buffer for LoRa message
+    char    tx_buf[MAX_MESSAGE_LENGTH + 1];    // Temporary buffer for LoRa message
+
+    if (status.build_string(tx_buf, sizeof(tx_buf))) {
+        uint8_t length = strlen(tx_buf);
+        uint32_t airtime = lora::time_on_air_ms(length + RH_RF95_HEADER_LEN, LORA_SF, LORA_BW_DIV, LORA_CR);
+
+        // Skip the message if it would exceed the duty cycle
+        airtime_budget.update(millis());
+        if (!airtime_budget.consume(airtime)) {
+            Serial.println("Airtime budget exceeded");
+            return;
+        }
 
-    if (status.build_string(tx_buf, 80)) {
         // Log the message on serial
         Serial.print(">>> "); Serial.println(tx_buf);
         // Send the data to server
-        lora.send((const uint8_t *)tx_buf, strlen(tx_buf));
+        lora.send((const uint8_t *)tx_buf, length);
     }
 }
 
@@ -30,6 +30,14 @@
 #define TOTAL_SLOTS 10              // Transmit period in seconds 
 #endif
 
+#ifndef SLOT_LENGTH
+#define SLOT_LENGTH TOTAL_SLOTS     // Own timeslot in seconds, a message must fit in it
+#endif
+
+#ifndef DUTY_CYCLE_PERMILLE
+#define DUTY_CYCLE_PERMILLE 500     // Maximum transmit duty cycle, averaged over a minute
+#endif
+
 
 #define FREQUENCY_MHZ 434.25        // Transmit center frequency, MHz
 #define TX_POWER_DBM   13           // Transmit power in dBm (range +5 .. +23)
@@ -48,6 +56,12 @@ RFOP = + 7 dBm, on RFO_LF/HF pin     20mA
 // * Bw125Cr48Sf4096    ///< Bw = 125 kHz, Cr = 4/8, Sf = 4096chips/symbol, CRC on. Slow+long range
 #define MODEM_MODE RH_RF95::Bw125Cr45Sf128
 
+// Modem parameters for the time on air calculation, must match MODEM_MODE
+// and the spreading factor set in lora_setup()
+#define LORA_SF               11
+#define LORA_BW_DIV           4       // 125 kHz (divider of 500 kHz, see airtime.h)
+#define LORA_CR               1       // 4/5
+
 #define LORA_RST_PIN          9       // Hardwired on the LoRa/GPS shield
 
 #ifdef LORA_MODIFIED
@@ -0,0 +1,292 @@
+// Host test and benchmark for the littlefs partition used by tiny-sky.
+//
+// The filesystem runs on a file-backed block device with the same geometry
+// as the firmware (lfs_flash.h). NOR flash semantics are emulated: programming
+// can only clear bits and erasing sets a whole block to 0xFF.
+//
+//  1. format/mount and append throughput, with block device operation counts
+//     and an estimate of the time the same operations take on the SPI flash
+//  2. power loss at many points during appends: the filesystem must mount
+//     afterwards and the file must contain at least everything up to the
+//     last completed sync, and nothing but valid records
+//
+// Build & run:  make && ./test_lfs [image_file]
+
+#include "lfs_flash.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csetjmp>
+#include <chrono>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Typical SPI NOR flash timings, used for the on-target estimate
+static const double kPageProgramMs  = 0.7;      // per 256 byte page
+static const double kSectorEraseMs  = 45.0;     // per 4 KB sector
+static const double kReadBytesPerMs = 2000.0;   // 16 MHz SPI clock
+
+struct FileBlockDevice {
+    int         fd;
+    uint32_t    reads, progs, erases;
+    uint64_t    read_bytes, prog_bytes, prog_pages;
+
+    // Power loss simulation: after this many program operations the current
+    // one is only half done and the device "loses power"
+    int         progs_left;
+    jmp_buf     power_loss;
+
+    void resetStats() {
+        reads = progs = erases = 0;
+        read_bytes = prog_bytes = prog_pages = 0;
+    }
+
+    double estimatedMs() const {
+        return prog_pages * kPageProgramMs + erases * kSectorEraseMs + read_bytes / kReadBytesPerMs;
+    }
+};
+
+static FileBlockDevice bd;
+
+static int file_read(const struct lfs_config *c, lfs_block_t block,
+    lfs_off_t off, void *buffer, lfs_size_t size)
+{
+    bd.reads++;
+    bd.read_bytes += size;
+    if (pread(bd.fd, buffer, size, (off_t)block * c->block_size + off) != (ssize_t)size) return LFS_ERR_IO;
+    return 0;
+}
+
+static int file_prog(const struct lfs_config *c, lfs_block_t block,
+    lfs_off_t off, const void *buffer, lfs_size_t size)
+{
+    bool lose_power = (bd.progs_left >= 0 && bd.progs_left-- == 0);
+    if (lose_power) size /= 2;
+
+    vector<uint8_t> data(size);
+    off_t address = (off_t)block * c->block_size + off;
+    if (pread(bd.fd, data.data(), size, address) != (ssize_t)size) return LFS_ERR_IO;
+    for (lfs_size_t i = 0; i < size; i++) {
+        data[i] &= ((const uint8_t *)buffer)[i];
+    }
+    if (pwrite(bd.fd, data.data(), size, address) != (ssize_t)size) return LFS_ERR_IO;
+
+    if (lose_power) longjmp(bd.power_loss, 1);
+
+    bd.progs++;
+    bd.prog_bytes += size;
+    bd.prog_pages += (off % 256 + size + 255) / 256;
+    return 0;
+}
+
+static int file_erase(const struct lfs_config *c, lfs_block_t block) {
+    vector<uint8_t> data(c->block_size, 0xFF);
+    bd.erases++;
+    if (pwrite(bd.fd, data.data(), c->block_size, (off_t)block * c->block_size) != (ssize_t)c->block_size) return LFS_ERR_IO;
+    return 0;
+}
+
+static int file_sync(const struct lfs_config *c) {
+    return 0;
+}
+
+static uint8_t read_buffer[LFS_FLASH_READ_SIZE];
+static uint8_t prog_buffer[LFS_FLASH_PROG_SIZE];
+static uint8_t file_buffer[LFS_FLASH_PROG_SIZE];
+static uint32_t lookahead_buffer[LFS_FLASH_LOOKAHEAD / 32];
+
+static struct lfs_config make_config() {
+    struct lfs_config cfg;
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.read  = file_read;
+    cfg.prog  = file_prog;
+    cfg.erase = file_erase;
+    cfg.sync  = file_sync;
+    cfg.read_size   = LFS_FLASH_READ_SIZE;
+    cfg.prog_size   = LFS_FLASH_PROG_SIZE;
+    cfg.block_size  = LFS_FLASH_BLOCK_SIZE;
+    cfg.block_count = LFS_FLASH_BLOCK_COUNT;
+    cfg.lookahead   = LFS_FLASH_LOOKAHEAD;
+    cfg.read_buffer = read_buffer;
+    cfg.prog_buffer = prog_buffer;
+    cfg.file_buffer = file_buffer;
+    cfg.lookahead_buffer = lookahead_buffer;
+    return cfg;
+}
+
+static const struct lfs_config cfg = make_config();
+static lfs_t lfs;
+
+static void erase_image() {
+    for (lfs_block_t block = 0; block < LFS_FLASH_BLOCK_COUNT; block++) {
+        file_erase(&cfg, block);
+    }
+}
+
+// Log records: 32 bytes, a sequence number repeated in each word
+static const int kRecordSize = 32;
+
+static void make_record(uint32_t seq, uint8_t *record) {
+    for (int i = 0; i < kRecordSize; i += 4) {
+        memcpy(record + i, &seq, 4);
+    }
+}
+
+static double elapsed_ms(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+static void print_stats(const char *what, double host_ms) {
+    printf("%-24s host %8.2f ms, %5u reads (%7lu B), %5u progs (%7lu B), %3u erases, target ~%.0f ms\n",
+        what, host_ms, bd.reads, (unsigned long)bd.read_bytes, bd.progs, (unsigned long)bd.prog_bytes,
+        bd.erases, bd.estimatedMs());
+}
+
+// Appends records to "log", syncing every sync_every bytes.
+// Updates synced with the number of records known to be on flash.
+static int append_log(uint32_t n_records, int sync_every, uint32_t &synced) {
+    lfs_file_t file;
+    int err = lfs_file_open(&lfs, &file, "log", LFS_O_WRONLY | LFS_O_CREAT | LFS_O_APPEND);
+    if (err < 0) return err;
+
+    lfs_soff_t size = lfs_file_size(&lfs, &file);
+    uint32_t seq = size / kRecordSize;
+    uint8_t record[kRecordSize];
+    for (uint32_t i = 0; i < n_records; i++, seq++) {
+        make_record(seq, record);
+        err = lfs_file_write(&lfs, &file, record, kRecordSize);
+        if (err < 0) break;
+        if (((seq + 1) * kRecordSize) % sync_every == 0) {
+            err = lfs_file_sync(&lfs, &file);
+            if (err < 0) break;
+            synced = seq + 1;
+        }
+    }
+    int err2 = lfs_file_close(&lfs, &file);
+    if (err >= 0 && err2 >= 0) synced = seq;
+    return (err < 0) ? err : err2;
+}
+
+// Checks that "log" only holds consecutive records, returns their count or -1
+static int verify_log() {
+    lfs_file_t file;
+    int err = lfs_file_open(&lfs, &file, "log", LFS_O_RDONLY);
+    if (err == LFS_ERR_NOENT) return 0;
+    if (err < 0) return -1;
+
+    uint8_t record[kRecordSize], expected[kRecordSize];
+    int count = 0;
+    while (true) {
+        int n = lfs_file_read(&lfs, &file, record, kRecordSize);
+        if (n == 0) break;
+        make_record(count, expected);
+        if (n != kRecordSize || memcmp(record, expected, kRecordSize) != 0) {
+            count = -1;
+            break;
+        }
+        count++;
+    }
+    lfs_file_close(&lfs, &file);
+    return count;
+}
+
+static bool test_throughput() {
+    erase_image();
+
+    bd.resetStats();
+    auto start = chrono::steady_clock::now();
+    if (lfs_format(&lfs, &cfg)) return false;
+    print_stats("format", elapsed_ms(start));
+
+    bd.resetStats();
+    start = chrono::steady_clock::now();
+    if (lfs_mount(&lfs, &cfg)) return false;
+    print_stats("mount (empty)", elapsed_ms(start));
+
+    const uint32_t n_records = (128 * 1024) / kRecordSize;
+    uint32_t synced = 0;
+    bd.resetStats();
+    start = chrono::steady_clock::now();
+    if (append_log(n_records, 4096, synced) < 0) return false;
+    double host_ms = elapsed_ms(start);
+    print_stats("append 128 KB", host_ms);
+    printf("%-24s ~%.1f KB/s on target\n", "", 128.0 / (bd.estimatedMs() / 1000));
+
+    lfs_unmount(&lfs);
+    bd.resetStats();
+    start = chrono::steady_clock::now();
+    if (lfs_mount(&lfs, &cfg)) return false;
+    print_stats("mount (128 KB log)", elapsed_ms(start));
+
+    bd.resetStats();
+    start = chrono::steady_clock::now();
+    int count = verify_log();
+    print_stats("read back", elapsed_ms(start));
+    lfs_unmount(&lfs);
+
+    if (count != (int)n_records) {
+        printf("Read back %d records, expected %u\n", count, n_records);
+        return false;
+    }
+    return true;
+}
+
+static bool test_power_loss(int n_trials) {
+    srand(1);
+    int failures = 0;
+    for (int trial = 0; trial < n_trials; trial++) {
+        erase_image();
+        bd.progs_left = -1;
+        if (lfs_format(&lfs, &cfg) || lfs_mount(&lfs, &cfg)) return false;
+
+        // Some history first, then lose power somewhere in the next appends
+        uint32_t synced = 0;
+        if (append_log(1000, 1024, synced) < 0) return false;
+
+        bd.progs_left = rand() % 200;
+        if (setjmp(bd.power_loss) == 0) {
+            append_log(4000, 1024, synced);
+        }
+        bd.progs_left = -1;
+
+        // Reboot
+        int err = lfs_mount(&lfs, &cfg);
+        int count = (err == 0) ? verify_log() : -1;
+        if (count < (int)synced) {
+            printf("Trial %d: mount err = %d, %d records after power loss, %u were synced\n",
+                trial, err, count, synced);
+            failures++;
+        }
+        // Must be usable again
+        else if (append_log(100, 1024, synced) < 0 || verify_log() != (int)synced) {
+            printf("Trial %d: append after power loss failed\n", trial);
+            failures++;
+        }
+        if (err == 0) lfs_unmount(&lfs);
+    }
+    printf("Power loss: %d/%d trials OK\n", n_trials - failures, n_trials);
+    return (failures == 0);
+}
+
+int main(int argc, char **argv) {
+    const char *path = (argc > 1) ? argv[1] : "test_lfs.img";
+    bd.fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (bd.fd < 0) {
+        perror(path);
+        return 1;
+    }
+    bd.progs_left = -1;
+
+    bool ok = test_throughput() && test_power_loss(200);
+
+    close(bd.fd);
+    if (argc <= 1) unlink(path);
+
+    printf(ok ? "OK\n" : "FAILED\n");
+    return ok ? 0 : 1;
+}
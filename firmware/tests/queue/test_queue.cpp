@@ -0,0 +1,81 @@
+// Stress test for the SPSC ring buffer in ptlib/queue.h
+//
+// A producer and a consumer thread pass a running sequence through a small
+// queue using a random mix of single, bulk and zero-copy operations. The
+// consumer checks that every value arrives exactly once and in order.
+//
+// Build & run:  g++ -O2 -pthread -I../../lib test_queue.cpp -o test_queue && ./test_queue
+
+#include <ptlib/queue.h>
+
+#include <iostream>
+#include <thread>
+#include <random>
+
+using namespace std;
+
+static const uint32_t kTotal = 2000000;
+
+static Queue<uint32_t, 64> queue;
+
+static void producer() {
+    mt19937 rng(1);
+    uint32_t next = 0;
+    uint32_t batch[40];
+    while (next < kTotal) {
+        if (rng() & 1) {
+            if (queue.push(next)) next++;
+            else this_thread::yield();
+        }
+        else {
+            uint32_t n = 1 + rng() % 40;
+            if (n > kTotal - next) n = kTotal - next;
+            for (uint32_t i = 0; i < n; i++) batch[i] = next + i;
+            uint32_t pushed = queue.push_n(batch, n);
+            if (pushed == 0) this_thread::yield();
+            next += pushed;
+        }
+    }
+}
+
+static bool consumer() {
+    mt19937 rng(2);
+    uint32_t expected = 0;
+    uint32_t batch[40];
+    while (expected < kTotal) {
+        uint32_t n = 0;
+        const uint32_t *data = batch;
+        switch (rng() % 3) {
+            case 0:
+                n = queue.pop(batch[0]) ? 1 : 0;
+                break;
+            case 1:
+                n = queue.pop_n(batch, 1 + rng() % 40);
+                break;
+            case 2:
+                n = queue.peek_contiguous(data);
+                break;
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            if (data[i] != expected) {
+                cerr << "Expected " << expected << ", got " << data[i] << endl;
+                return false;
+            }
+            expected++;
+        }
+        if (data != batch) queue.consume(n);
+        if (n == 0) this_thread::yield();
+    }
+    return queue.empty();
+}
+
+int main() {
+    bool ok = false;
+    thread t_producer(producer);
+    thread t_consumer([&ok] { ok = consumer(); });
+    t_producer.join();
+    t_consumer.join();
+
+    cout << (ok ? "OK" : "FAILED") << endl;
+    return ok ? 0 : 1;
+}
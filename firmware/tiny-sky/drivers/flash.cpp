@@ -24,18 +24,21 @@ enum cmd_t {
     CMD_PP      = 0x02, // Page Program
     CMD_ID      = 0x9F, // Read JEDEC-ID
     CMD_WAKE    = 0xAB,
-    CMD_ULBPR   = 0x98
+    CMD_ULBPR   = 0x98,
+    CMD_WRSU    = 0xB0, // Suspend Program/Erase
+    CMD_WRRE    = 0x30  // Resume Program/Erase
 };
 
+// The first and last 64 KB may be divided into smaller blocks (SST26), so
+// CMD_BE is only used for the uniform blocks in between
+#define BLOCK_REGION_START  0x10000
+
 bool SPIFlash_Base::initialize() {
     cmdWake();
 
     cmdReset();
 
-    uint8_t tmp32[4];        // hex: 53 46 44 50 = 'SFDP'
-
-    cmdSFDP(0x0000, tmp32, 4);
-    if (memcmp(tmp32, "SFDP", 4) != 0) 
+    if (!parseSFDP()) 
         return false;
 
     //cmdWriteStatusRegister(0, 0);
@@ -44,35 +47,72 @@ bool SPIFlash_Base::initialize() {
     return true;
 }
 
-uint32_t SPIFlash_Base::chipSize() {
-    uint8_t tmp32[4];
-
-    cmdSFDP(0x000C, tmp32, 4);
-    uint32_t table_addr = tmp32[0] | (tmp32[1] << 8) | (tmp32[2] << 16);
+// Parses the JEDEC basic flash parameter table (JESD216) once and caches
+// the geometry, erase types and typical timings
+bool SPIFlash_Base::parseSFDP() {
+    uint8_t header[16];        // hex: 53 46 44 50 = 'SFDP'
 
-    cmdSFDP(0x0004 + table_addr, tmp32, 4);
-    uint32_t flash_top = (tmp32[0] | (tmp32[1] << 8) | (tmp32[2] << 16) | (tmp32[3] << 24));
-
-    if (flash_top == 0) return 0;
+    cmdSFDP(0x0000, header, 16);
+    if (memcmp(header, "SFDP", 4) != 0) 
+        return false;
 
-    // Convert number of bits to bytes
-    uint32_t flash_size = (flash_top + 1) / 8;
+    // The first parameter header always points to the basic table
+    int n_dwords = header[11];
+    uint32_t table_addr = header[12] | (header[13] << 8) | (header[14] << 16);
+    if (header[8] != 0x00 || n_dwords < 9) 
+        return false;
 
-    // Check for overflow (512 MBytes = 2^32 bits)
-    return (flash_size > 0) ? flash_size : (1 << 29);
-}
+    uint32_t dw[11] = {};
+    if (n_dwords > 11) n_dwords = 11;
+    cmdSFDP(table_addr, (uint8_t *)dw, n_dwords * 4);
+
+    // 1st DWORD: 4 KB erase, address bytes, fast read modes
+    if (((dw[0] >> 17) & 0x03) == 0x02) 
+        return false;       // 4 byte addressing only
+    _sector_size = ((dw[0] & 0x03) == 0x01) ? 4096 : 0;
+    _dual_read_opcode = (dw[0] & (1 << 16)) ? (uint8_t)(dw[3] >> 8) : 0;
+
+    // 2nd DWORD: density in bits, limited to what 3 byte addresses can reach
+    uint32_t density = dw[1];
+    if (density & 0x80000000) {
+        uint32_t log2_bits = density & 0x7FFFFFFF;
+        _chip_size = (log2_bits >= 27) ? (1UL << 24) : (1UL << (log2_bits - 3));
+    }
+    else {
+        _chip_size = (density / 8) + 1;
+    }
+    if (_chip_size > (1UL << 24)) _chip_size = (1UL << 24);
+
+    // 8th and 9th DWORD: erase types (size as power of two and opcode)
+    _block_size = 0;
+    for (int i = 0; i < 4; i++) {
+        uint8_t size_exp = (uint8_t)(dw[7 + i / 2] >> (16 * (i % 2)));
+        uint8_t opcode   = (uint8_t)(dw[7 + i / 2] >> (16 * (i % 2) + 8));
+        _erase_types[i].size = (size_exp > 0) ? (1UL << size_exp) : 0;
+        _erase_types[i].opcode = opcode;
+        _erase_types[i].time_ms = 0;
+        if (opcode == CMD_BE && _erase_types[i].size > _block_size) {
+            _block_size = _erase_types[i].size;
+        }
+    }
 
-uint32_t SPIFlash_Base::sectorSize() {
-    uint8_t tmp32[4];
+    // 10th and 11th DWORD (JESD216A and later): typical timings, page size
+    if (n_dwords >= 11) {
+        static const uint16_t erase_units[] = { 1, 16, 128, 1000 };
+        for (int i = 0; i < 4; i++) {
+            if (_erase_types[i].size == 0) continue;
+            uint32_t field = dw[9] >> (4 + 7 * i);
+            _erase_types[i].time_ms = ((field & 0x1F) + 1) * erase_units[(field >> 5) & 0x03];
+        }
 
-    cmdSFDP(0x000C, tmp32, 4);
-    uint32_t table_addr = tmp32[0] | (tmp32[1] << 8) | (tmp32[2] << 16);
+        _page_size = 1UL << ((dw[10] >> 4) & 0x0F);
+        _page_program_us = (((dw[10] >> 8) & 0x1F) + 1) * ((dw[10] & (1 << 13)) ? 64 : 8);
 
-    cmdSFDP(0x0000 + table_addr, tmp32, 4);
-    uint8_t sectorSizeType = (tmp32[0] & 0x03);
+        static const uint32_t chip_erase_units[] = { 16, 256, 4000, 64000 };
+        _chip_erase_ms = (((dw[10] >> 24) & 0x1F) + 1) * chip_erase_units[(dw[10] >> 29) & 0x03];
+    }
 
-    // We only recognize type 1, 4096 bytes
-    return (sectorSizeType == 1) ? 4096 : 0;
+    return (_chip_size > 0 && _sector_size > 0);
 }
 
 bool SPIFlash_Base::busy()
@@ -119,16 +159,30 @@ void SPIFlash_Base::cmdSFDP(uint32_t address, uint8_t *rd_buf, int rd_len) {
 }
 
 void SPIFlash_Base::read(uint32_t address, uint8_t *rd_buf, int rd_len) {
-    uint8_t wr_buf[] = {
-        (uint8_t)(address >> 24),
-        (uint8_t)(address >> 16),
-        (uint8_t)(address >>  8),
-        (uint8_t)(address >>  0)
-    };
-    sendCommand(CMD_READ, wr_buf + ADDRESS_SHIFT, ADDRESS_LENGTH, rd_buf, rd_len);
+    // Long reads are split into page sized commands, so that other devices on
+    // the bus don't have to wait for the whole transfer
+    while (rd_len > 0) {
+        int length = (rd_len < _page_size) ? rd_len : _page_size;
+
+        // Fast read: one dummy byte after the address, no clock limit below the
+        // maximum SPI frequency (plain CMD_READ is limited to 25-50 MHz)
+        uint8_t wr_buf[] = {
+            (uint8_t)(address >> 24),
+            (uint8_t)(address >> 16),
+            (uint8_t)(address >>  8),
+            (uint8_t)(address >>  0),
+            0
+        };
+        sendCommand(CMD_READF, wr_buf + ADDRESS_SHIFT, ADDRESS_LENGTH + 1, rd_buf, length);
+
+        address += length;
+        rd_buf += length;
+        rd_len -= length;
+    }
 }
 
 void SPIFlash_Base::programPage(uint32_t address, const uint8_t *wr_buf, int wr_len) {
+    _erase_active = false;  // busy() is this program now, not a background erase
     uint8_t cmd_u8 = (uint8_t)CMD_PP;
     uint8_t addr_buf[] = {
         (uint8_t)(address >> 24),
@@ -149,6 +203,7 @@ void SPIFlash_Base::programPage(uint32_t address, const uint8_t *wr_buf, int wr_
 }
 
 void SPIFlash_Base::eraseSector(uint32_t address) {
+    _erase_active = false;  // not part of a background erase
     uint8_t wr_buf[] = {
         (uint8_t)(address >> 24),
         (uint8_t)(address >> 16),
@@ -161,6 +216,7 @@ void SPIFlash_Base::eraseSector(uint32_t address) {
 }
 
 void SPIFlash_Base::eraseBlock(uint32_t address) {
+    _erase_active = false;  // not part of a background erase
     uint8_t wr_buf[] = {
         (uint8_t)(address >> 24),
         (uint8_t)(address >> 16),
@@ -174,11 +230,87 @@ void SPIFlash_Base::eraseBlock(uint32_t address) {
 }
 
 void SPIFlash_Base::eraseChip() {
+    _erase_active = false;  // not part of a background erase
     sendCommand(CMD_WREN);
     waitTCPH();
     sendCommand(CMD_CE);
 }
 
+void SPIFlash_Base::eraseStart(uint32_t address, uint32_t length) {
+    // Restarting while erasing extends the range to cover the previous one
+    uint32_t end = address + length;
+    if (erasing()) {
+        if (_erase_start < address) address = _erase_start;
+        if (eraseEndOfPending() > end) end = eraseEndOfPending();
+    }
+    _erase_start = address;
+    _erase_next = end;
+}
+
+bool SPIFlash_Base::erasePoll() {
+    if (!erasing()) return false;
+    if (busy()) return true;
+    _erase_active = false;
+    if (_erase_next <= _erase_start) return false;
+
+    uint32_t remaining = _erase_next - _erase_start;
+
+    _erase_current = _erase_next;
+    if (_erase_start == 0 && remaining >= _chip_size) {
+        eraseChip();
+        _erase_next = _erase_start;
+    }
+    else if (_block_size > 0 && (_erase_next % _block_size) == 0 && remaining >= _block_size && 
+        _erase_next >= BLOCK_REGION_START + _block_size && _erase_next + BLOCK_REGION_START <= _chip_size)
+    {
+        _erase_next -= _block_size;
+        eraseBlock(_erase_next);
+    }
+    else {
+        _erase_next -= _sector_size;
+        eraseSector(_erase_next);
+    }
+    _erase_active = true;
+    return true;
+}
+
+bool SPIFlash_Base::erasing() {
+    return _erase_active || _erase_next > _erase_start;
+}
+
+uint32_t SPIFlash_Base::eraseEndOfPending() {
+    return (_erase_active && _erase_current > _erase_next) ? _erase_current : _erase_next;
+}
+
+uint32_t SPIFlash_Base::eraseRemaining() {
+    uint32_t end = eraseEndOfPending();
+    return (end > _erase_start) ? (end - _erase_start) : 0;
+}
+
+bool SPIFlash_Base::erasePending(uint32_t address, uint32_t length) {
+    if (!erasing()) return false;
+    return (address < eraseEndOfPending() && address + length > _erase_start);
+}
+
+bool SPIFlash_Base::eraseSuspend() {
+    if (!_erase_active) return false;
+    if (!busy()) {
+        // Already finished
+        _erase_active = false;
+        return false;
+    }
+    sendCommand(CMD_WRSU);
+    while (busy()) {
+        // idle wait (suspend latency is 10 us typ.)
+    }
+    return true;
+}
+
+void SPIFlash_Base::eraseResume() {
+    sendCommand(CMD_WRRE);
+    _erase_active = true;
+}
+
 void SPIFlash_Base::cmdReadConfigRegister(uint8_t &value) {
     sendCommand(CMD_RDCR, 0, 0, &value, 1);
 }
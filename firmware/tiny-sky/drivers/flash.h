@@ -4,10 +4,23 @@
 
 class SPIFlash_Base { // : public SPIDeviceBase 
 public:
+    struct EraseType {
+        uint32_t    size;       // bytes, 0 if this type is not supported
+        uint8_t     opcode;
+        uint16_t    time_ms;    // typical erase time, 0 if not specified
+    };
+
+    // Reads the geometry from the SFDP tables, returns false if there is no
+    // usable JEDEC basic flash parameter table
     bool initialize();
 
-    uint32_t chipSize();
-    uint32_t sectorSize();
+    uint32_t chipSize()     { return _chip_size; }
+    uint32_t sectorSize()   { return _sector_size; }
+    uint32_t pageSize()     { return _page_size; }
+    uint16_t pageProgramTime()  { return _page_program_us; }    // typical, microseconds
+    uint32_t chipEraseTime()    { return _chip_erase_ms; }      // typical, milliseconds
+    bool     hasDualRead()  { return _dual_read_opcode != 0; }
+    const EraseType & eraseType(int index)   { return _erase_types[index]; }
 
     bool busy();
     void cmdReadStatusRegister(uint8_t &value);
@@ -19,9 +32,32 @@ public:
     void eraseBlock(uint32_t address);
     void eraseChip();
 
+    // Background erase of a sector aligned address range. erasePoll() must be
+    // called periodically, it starts the next erase operation (chip, 64 KB block
+    // or 4 KB sector, whichever fits the rest of the range) once the previous
+    // one has finished. Returns true while the erase is in progress. The range
+    // is erased from its end down, so an interrupted erase leaves its start
+    // untouched.
+    void eraseStart(uint32_t address, uint32_t length);
+    bool erasePoll();
+    bool erasing();
+    uint32_t eraseRemaining();
+
+    // Returns true if the range overlaps the part of the background erase
+    // that is not finished yet (so it must not be read or programmed)
+    bool erasePending(uint32_t address, uint32_t length);
+
+    // Suspends a running erase operation, so that other blocks can be read or
+    // programmed without waiting for it. Returns true if it was suspended,
+    // in which case eraseResume() must be called afterwards.
+    bool eraseSuspend();
+    void eraseResume();
+
 protected:
     void sendCommand(uint8_t command, const uint8_t *wr_buf = 0, int wr_len = 0, uint8_t *rd_buf = 0, int rd_len = 0);
     void waitTCPH();
+    uint32_t eraseEndOfPending();
+    bool parseSFDP();
 
     void cmdReset();
     void cmdWake();
@@ -31,6 +67,20 @@ protected:
     void cmdReadConfigRegister(uint8_t &value);
     void cmdWriteStatusRegister(uint8_t value1, uint8_t value2 = 0);
 
+    uint32_t    _chip_size = 0;
+    uint32_t    _sector_size = 0;
+    uint32_t    _block_size = 0;        // largest uniform erase type
+    uint32_t    _page_size = 256;
+    uint16_t    _page_program_us = 0;
+    uint32_t    _chip_erase_ms = 0;
+    uint8_t     _dual_read_opcode = 0;  // 1-1-2 fast read (informational, the bus is single I/O)
+    EraseType   _erase_types[4] = {};
+
+    uint32_t    _erase_start = 0;
+    uint32_t    _erase_next = 0;        // end of the next erase operation
+    uint32_t    _erase_current = 0;     // end of the running erase operation
+    bool        _erase_active = false;  // the last operation issued is a background erase step
+
 protected:
     virtual void select() = 0;
     virtual void release() = 0;
@@ -86,6 +86,25 @@
 #define VALUE_SLEEP_G           0x40
 #define VALUE_DRDY_MASK         0x08
 
+// FIFO_CTRL3
+#define VALUE_DEC_FIFO_G_SHIFT  3
+#define VALUE_DEC_FIFO_XL_SHIFT 0
+
+// FIFO_CTRL5
+#define VALUE_ODR_FIFO_SHIFT    3
+#define VALUE_ODR_FIFO_MASK     0x78
+#define VALUE_FIFO_MODE_MASK    0x07
+
+// FIFO_STATUS2
+#define VALUE_FTH               0x80
+#define VALUE_FIFO_OVER_RUN     0x40
+#define VALUE_FIFO_FULL         0x20
+#define VALUE_FIFO_EMPTY        0x10
+#define VALUE_DIFF_FIFO_H_MASK  0x0F
+
+// Words per FIFO sample (gyro XYZ + accel XYZ)
+#define FIFO_SAMPLE_WORDS       6
+
 // CTRL7_G
 #define VALUE_HP_G_EN           0x40
 
@@ -132,6 +151,95 @@ void LSM6DS33::readTemperature_12q4(int16_t &temperature) {
     temperature = (int16_t)(data[0] | (data[1] << 8));
 }
 
+bool LSM6DS33::startRead(I2CRequest &req) {
+    return readRegisterAsync(req, REG_STATUS, sample, sizeof(sample));
+}
+
+bool LSM6DS33::sampleReady(bool gyro, bool accel) {
+    uint8_t status = sample[0];
+    if (gyro && !(status & VALUE_GDA)) return false;
+    if (accel && !(status & VALUE_XLDA)) return false;
+    return true;
+}
+
+void LSM6DS33::sampleMeasurement(int16_t &gx, int16_t &gy, int16_t &gz, int16_t &ax, int16_t &ay, int16_t &az) {
+    const uint8_t *data = sample + (REG_OUTX_G_L - REG_STATUS);
+    gx = data[0] | (data[1] << 8);
+    gy = data[2] | (data[3] << 8);
+    gz = data[4] | (data[5] << 8);
+    ax = data[6] | (data[7] << 8);
+    ay = data[8] | (data[9] << 8);
+    az = data[10] | (data[11] << 8);
+}
+
+void LSM6DS33::sampleTemperature_12q4(int16_t &temperature) {
+    const uint8_t *data = sample + (REG_OUT_TEMP_L - REG_STATUS);
+    temperature = (int16_t)(data[0] | (data[1] << 8));
+}
+
+void LSM6DS33::setupFIFO(fifo_mode_t mode, odr_g_t odr, uint16_t watermark, fifo_dec_t decimation) {
+    // Switch to bypass first, this also empties the FIFO
+    writeRegister(REG_FIFO_CTRL5, eFIFO_BYPASS);
+
+    uint16_t threshold = watermark * FIFO_SAMPLE_WORDS;    // in 16-bit words
+    writeRegister(REG_FIFO_CTRL1, threshold & 0xFF);
+    writeRegister(REG_FIFO_CTRL2, (threshold >> 8) & 0x0F);
+    writeRegister(REG_FIFO_CTRL3, (decimation << VALUE_DEC_FIFO_G_SHIFT) | (decimation << VALUE_DEC_FIFO_XL_SHIFT));
+    writeRegister(REG_FIFO_CTRL4, 0);
+
+    fifo_odr = odr;
+    fifo_dec = decimation;
+    if (mode != eFIFO_BYPASS) {
+        uint8_t reg = ((odr << VALUE_ODR_FIFO_SHIFT) & VALUE_ODR_FIFO_MASK) | (mode & VALUE_FIFO_MODE_MASK);
+        writeRegister(REG_FIFO_CTRL5, reg);
+    }
+}
+
+// Returns the number of complete samples stored in the FIFO
+int LSM6DS33::fifoLevel(bool *overrun) {
+    uint8_t status[2];
+    if (!readRegister(REG_FIFO_STATUS1, status, 2)) return 0;
+    if (overrun) *overrun = (status[1] & VALUE_FIFO_OVER_RUN) != 0;
+    int words = status[0] | ((status[1] & VALUE_DIFF_FIFO_H_MASK) << 8);
+    return words / FIFO_SAMPLE_WORDS;
+}
+
+// Drains up to max_count samples with a single burst read.
+// Returns the number of samples read.
+int LSM6DS33::readFIFO(sample_t *samples, int max_count) {
+    uint8_t status[4];
+    if (!readRegister(REG_FIFO_STATUS1, status, 4)) return 0;
+
+    int words = status[0] | ((status[1] & VALUE_DIFF_FIFO_H_MASK) << 8);
+    int pattern = status[2] | ((status[3] & 0x03) << 8);
+
+    // Realign to the start of a gyro/accel set if a previous read was cut short
+    if (pattern != 0) {
+        uint8_t dummy[2 * FIFO_SAMPLE_WORDS];
+        int skip = FIFO_SAMPLE_WORDS - pattern;
+        if (skip > words) return 0;
+        if (!readRegister(REG_FIFO_DATA_OUT_L, dummy, 2 * skip)) return 0;
+        words -= skip;
+    }
+
+    int count = words / FIFO_SAMPLE_WORDS;
+    if (count > max_count) count = max_count;
+    if (count == 0) return 0;
+
+    // The address pointer rolls back to FIFO_DATA_OUT_L, so all samples
+    // come out in one transfer. Data is little endian, as is the sample_t layout.
+    if (!readRegister(REG_FIFO_DATA_OUT_L, (uint8_t *)samples, count * sizeof(sample_t))) return 0;
+    return count;
+}
+
+// Interval between consecutive FIFO samples
+uint32_t LSM6DS33::fifoIntervalUs() {
+    static const uint32_t odr_interval[] = { 0, 80000, 38462, 19231, 9615, 4808, 2404, 1200, 600 };
+    static const uint8_t  dec_factor[]   = { 0, 1, 2, 3, 4, 8, 16, 32 };
+    if (fifo_odr >= sizeof(odr_interval) / sizeof(odr_interval[0])) return 0;
+    return odr_interval[fifo_odr] * dec_factor[fifo_dec & 0x07];
+}
+
 // void LSM6DS33::setODR(odr_xl_t odr_xl, odr_g_t odr_g) {
 //     setGyroODR(odr_g);
 //     setAccelODR(odr_xl);
@@ -56,6 +56,30 @@ public:
         eFS_G_2000DPS  = 6
     };
 
+    enum fifo_mode_t {
+        eFIFO_BYPASS                = 0,
+        eFIFO_STOP_WHEN_FULL        = 1,
+        eFIFO_CONTINUOUS_TO_FIFO    = 3,
+        eFIFO_BYPASS_TO_CONTINUOUS  = 4,
+        eFIFO_CONTINUOUS            = 6
+    };
+
+    enum fifo_dec_t {
+        eFIFO_DEC_1     = 1,
+        eFIFO_DEC_2     = 2,
+        eFIFO_DEC_3     = 3,
+        eFIFO_DEC_4     = 4,
+        eFIFO_DEC_8     = 5,
+        eFIFO_DEC_16    = 6,
+        eFIFO_DEC_32    = 7
+    };
+
+    // One FIFO entry: gyro followed by accel, raw sensor axes
+    struct sample_t {
+        int16_t gx, gy, gz;
+        int16_t ax, ay, az;
+    };
+
     bool initialize();
     void reset();
 
@@ -75,9 +99,25 @@ public:
 
     void readTemperature_12q4(int16_t &temperature);
 
+    // Non-blocking burst read of STATUS, temperature, gyro and accel outputs
+    bool startRead(I2CRequest &req);
+    bool sampleReady(bool gyro = true, bool accel = true);
+    void sampleMeasurement(int16_t &gx, int16_t &gy, int16_t &gz, int16_t &ax, int16_t &ay, int16_t &az);
+    void sampleTemperature_12q4(int16_t &temperature);
+
+    // FIFO stores gyro and accel data sets at the same rate (odr / decimation).
+    // Watermark is given in samples (gyro+accel pairs).
+    void setupFIFO(fifo_mode_t mode, odr_g_t odr, uint16_t watermark, fifo_dec_t decimation = eFIFO_DEC_1);
+    int  fifoLevel(bool *overrun = 0);
+    int  readFIFO(sample_t *samples, int max_count);
+    uint32_t fifoIntervalUs();
+
     //void setODR(odr_xl_t odr_xl, odr_g_t odr_g);
     void setupGyro(odr_g_t odr_g, fs_g_t fs_g);
     void setupAccel(odr_xl_t odr_xl, fs_xl_t fs_xl);
 
 private:
+    uint8_t sample[16];     // REG_STATUS .. REG_OUTZ_XL_H
+    uint8_t fifo_odr;
+    uint8_t fifo_dec;
 };
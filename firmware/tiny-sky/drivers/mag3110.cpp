@@ -179,6 +179,20 @@ bool MAG3110::readMag(int16_t &x, int16_t &y, int16_t &z) {
 	return true; // FIXME
 }
 
+bool MAG3110::startRead(I2CRequest &req) {
+	return readRegisterAsync(req, MAG3110_DR_STATUS, sample, sizeof(sample));
+}
+
+bool MAG3110::sampleReady() {
+	return (sample[0] & 0x08) != 0;
+}
+
+void MAG3110::sampleMag(int16_t &x, int16_t &y, int16_t &z) {
+	x = (int16_t)((sample[1] << 8) | sample[2]);
+	y = (int16_t)((sample[3] << 8) | sample[4]);
+	z = (int16_t)((sample[5] << 8) | sample[6]);
+}
+
 bool MAG3110::readMicroTeslas(float &x, float &y, float &z) {
 	//Read each axis and scale to Teslas
 	x = readAxis(eX_AXIS) * 0.1f;
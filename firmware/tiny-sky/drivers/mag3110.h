@@ -44,6 +44,11 @@ public:
     bool dataReady();
 
     bool readMag(int16_t &x, int16_t &y, int16_t &z);
+
+    // Non-blocking burst read of DR_STATUS and X/Y/Z, decode after completion
+    bool startRead(I2CRequest &req);
+    bool sampleReady();
+    void sampleMag(int16_t &x, int16_t &y, int16_t &z);
     bool readMicroTeslas(float &x, float &y, float &z);
     float readHeading();
 
@@ -57,4 +62,6 @@ public:
 
 private:
     int16_t readAxis(uint8_t axis);
+
+    uint8_t sample[7];
 };
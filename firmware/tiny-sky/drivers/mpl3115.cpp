@@ -149,6 +149,23 @@ void MPL3115::readTemperature_12q4(int16_t &temperature) {
     temperature = (int16_t)((t_bytes[0] << 8) | (t_bytes[1] & 0xF0)) >> 4;
 }
 
+bool MPL3115::startRead(I2CRequest &req) {
+    // STATUS mirrors DR_STATUS while the FIFO is disabled
+    return readRegisterAsync(req, REG_STATUS, sample, sizeof(sample));
+}
+
+bool MPL3115::sampleReady() {
+	return (sample[0] & (VALUE_PDR | VALUE_TDR)) == (VALUE_PDR | VALUE_TDR);
+}
+
+void MPL3115::samplePressure_u28q4(uint32_t &pressure) {
+    pressure = ((sample[1] << 16) | (sample[2] << 8) | (sample[3] & 0xF0)) >> 2;
+}
+
+void MPL3115::sampleTemperature_12q4(int16_t &temperature) {
+    temperature = (int16_t)((sample[4] << 8) | (sample[5] & 0xF0)) >> 4;
+}
+
 void MPL3115::setOSR(osr_t osr) {
 	uint8_t current;
     readRegister(REG_CTRL_REG1, current);
@@ -33,7 +33,14 @@ public:
     void readPressure_u28q4(uint32_t &pressure);
     void readTemperature_12q4(int16_t &temperature);
 
+    // Non-blocking burst read of STATUS and P/T outputs, decode after completion
+    bool startRead(I2CRequest &req);
+    bool sampleReady();
+    void samplePressure_u28q4(uint32_t &pressure);
+    void sampleTemperature_12q4(int16_t &temperature);
+
     void setOSR(osr_t osr);
 
 private:
+    uint8_t sample[6];
 };
@@ -2,32 +2,25 @@
 
 #include <stdint.h>
 
-class SPIDeviceBase {
-public:
-    void writeReg (uint8_t addr, uint8_t data);
-    uint8_t readReg (uint8_t addr);
-    void writeBuf (uint8_t addr, const uint8_t * buf, uint8_t len);
-    void readBuf (uint8_t addr, uint8_t * buf, uint8_t len);
-    void writeCommand (uint8_t cmd);
-    void writeCommand (uint8_t cmd, const uint8_t *data_out, int size_out, uint8_t *data_in, int size_in);
-
-protected:
-    // Abstract virtual methods to be implemented in a subclass
-
-    /*
-    * perform 8-bit SPI transaction
-    *   - write given byte 'outval'
-    *   - read byte and return value
-    */
-    virtual uint8_t hal_spi_transfer (uint8_t outval) = 0;
-
-    /*
-    * drive device NSS pin (0=low, 1=high).
-    */
-    virtual void hal_pin_nss (uint8_t val) = 0;
-};
-
-class SX1276_Base : public SPIDeviceBase {
+#include <lora/airtime.h>
+
+// The HAL is a policy class with static methods, so register accesses compile
+// to direct calls:
+//
+//   struct HAL {
+//       static void select();                   // drive NSS low
+//       static void release();                  // drive NSS high
+//       static uint8_t transfer(uint8_t outval);
+//       static void transfer(const uint8_t *tx, uint8_t *rx, int len);  // tx or rx may be 0
+//       static void pin_rst(uint8_t val);       // 0=low, 1=high
+//       static void pin_rxtx(uint8_t val);      // antenna switch, 0=rx, 1=tx
+//       static void delay_us(uint32_t us);
+//   };
+//
+// Method definitions are in sx1276_impl.h, which must be included in exactly
+// one source file together with an explicit instantiation for the HAL.
+template<typename HAL>
+class SX1276 {
 public:
     enum sf_t {
         eSF_6       = 6,
@@ -86,10 +79,32 @@ public:
         ModemSettings & setSF(sf_t new_sf) { spreading_factor = new_sf; return *this; }
         ModemSettings & setBW(bw_t new_bw) { bandwidth = new_bw; return *this; }
         ModemSettings & setCR(cr_t new_cr) { coding_rate = new_cr; return *this; }
+
+        // Divider of 500 kHz (see lora/airtime.h)
+        uint8_t bandwidthDivider() const {
+            static const uint8_t dividers[] = { 64, 48, 32, 24, 16, 12, 8, 4, 2, 1 };
+            return dividers[bandwidth];
+        }
+
+        bool lowDataRate() const {
+            return lora::low_data_rate(spreading_factor, bandwidthDivider());
+        }
+
+        // Time on air of a packet with the given payload length
+        uint32_t timeOnAirUs(uint8_t length) const {
+            return lora::time_on_air_us(length, spreading_factor, bandwidthDivider(), coding_rate,
+                preamble_length, !disable_crc, implicit_header);
+        }
     };
 
     void init(void);
     bool checkVersion();
+
+    void writeReg (uint8_t addr, uint8_t data);
+    uint8_t readReg (uint8_t addr);
+    // Burst access to consecutive registers in a single chip select window
+    void writeRegs (uint8_t addr, const uint8_t *values, uint8_t count);
+    void readRegs (uint8_t addr, uint8_t *values, uint8_t count);
     
     void setFrequencyHz (uint32_t frequency);
     void setFrequencyMHz (float frequency);
@@ -111,9 +126,24 @@ public:
     int8_t getPacketRSSI();
     int8_t getPacketSNR();
 
+    // LoRa IRQ flags as returned by getIRQFlags() and handleIRQ()
+    enum irq_flags_t {
+        eIRQ_TX_DONE    = 0x08,
+        eIRQ_CRC_ERROR  = 0x20,
+        eIRQ_RX_DONE    = 0x40,
+        eIRQ_RX_TIMEOUT = 0x80
+    };
+
     uint8_t getIRQFlags();
 
-    void handleIRQ();
+    // Time on air of a frame passed to writeFIFO() with the current LoRa
+    // settings, including any header added by the driver
+    uint32_t timeOnAirUs(uint8_t length);
+    // Same with other settings
+    uint32_t timeOnAirUs(uint8_t length, const ModemSettings &settings);
+
+    // Reads and clears the IRQ flags, masks further IRQs. Returns the flags.
+    uint8_t handleIRQ();
 
 protected:
     enum lr_mode_t { 
@@ -138,58 +168,10 @@ protected:
     //void rxChainCalibration();
     //void seedRandom();
 
-    virtual void onTXDone();
-    virtual void onRXDone();
-    virtual void onRXTimeout();
+    // Shadow of RegOpMode, which is only written by the driver. The mode
+    // bits may be stale (the radio returns to standby by itself), but they
+    // are always overwritten, so no read-modify-write is needed.
+    uint8_t _opmode;
 
-protected:
-    /* Virtual HAL methods */
-
-    /*
-    * drive radio RX/TX pins (0=rx, 1=tx).
-    */
-    virtual void hal_pin_rxtx (uint8_t val) = 0;
-
-    /*
-    * control radio RST pin (0=low, 1=high, 2=floating)
-    */
-    virtual void hal_pin_rst (uint8_t val) = 0;
-
-    /*
-    * disable all CPU interrupts.
-    *   - might be invoked nested 
-    *   - will be followed by matching call to hal_enableIRQs()
-    */
-    virtual void hal_disableIRQs (void) = 0;
-
-    /*
-    * enable CPU interrupts.
-    */
-    virtual void hal_enableIRQs (void) = 0;
-
-    /*
-    * put system and CPU in low-power mode, sleep until interrupt.
-    */
-    //virtual void hal_sleep (void) = 0;
-
-    virtual void hal_delay_us (uint32_t us) = 0;
-
-    /*
-    * return 32-bit system time in ticks.
-    */
-    //virtual uint32_t hal_ticks (void) = 0;
-
-    /*
-    * busy-wait until specified timestamp (in ticks) is reached.
-    */
-    //virtual void hal_waitUntil (uint32_t time) = 0;
-
-    //virtual uint32_t hal_ms2ticks(uint32_t ms) = 0;
-    
-    /*
-    * check and rewind timer for target time.
-    *   - return 1 if target time is close
-    *   - otherwise rewind timer for target time or full period and return 0
-    */
-    //virtual uint8_t hal_checkTimer (uint32_t targettime) = 0;
+    ModemSettings _modem;       // last LoRa settings
 };
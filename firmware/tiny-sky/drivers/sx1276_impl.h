@@ -4,6 +4,8 @@
  * Based on portions of LMIC code by IBM Corporation.
  */
 
+#pragma once
+
 #include "sx1276.h"
 #include "sx1276_regs.h"
 
@@ -11,72 +13,54 @@
 #define F_XOSC_HZ                32000000UL
 #define THRESHOLD_LOWFREQ_HZ    525000000UL
 
-void SPIDeviceBase::writeReg (uint8_t addr, uint8_t data ) {
-    hal_pin_nss(0);
-    hal_spi_transfer(addr | 0x80);
-    hal_spi_transfer(data);
-    hal_pin_nss(1);
+template<typename HAL>
+void SX1276<HAL>::writeReg (uint8_t addr, uint8_t data) {
+    HAL::select();
+    HAL::transfer(addr | 0x80);
+    HAL::transfer(data);
+    HAL::release();
 }
 
-uint8_t SPIDeviceBase::readReg (uint8_t addr) {
-    hal_pin_nss(0);
-    hal_spi_transfer(addr & 0x7F);
-    uint8_t val = hal_spi_transfer(0x00);
-    hal_pin_nss(1);
+template<typename HAL>
+uint8_t SX1276<HAL>::readReg (uint8_t addr) {
+    HAL::select();
+    HAL::transfer(addr & 0x7F);
+    uint8_t val = HAL::transfer(0x00);
+    HAL::release();
     return val;
 }
 
-void SPIDeviceBase::writeCommand (uint8_t command) {
-    hal_pin_nss(0);
-    hal_spi_transfer(command);
-    hal_pin_nss(1);
-}
-
-void SPIDeviceBase::writeCommand (uint8_t cmd, const uint8_t *data_out, int size_out, uint8_t *data_in, int size_in)
-{
-    hal_pin_nss(0);
-    hal_spi_transfer(cmd);
-    for (uint8_t i = 0; i < size_out; i++) {
-        hal_spi_transfer(data_out[i]);
-    }
-    for (uint8_t i = 0; i < size_in; i++) {
-        data_in[i] = hal_spi_transfer(0x00);
-    }
-    hal_pin_nss(1);    
+template<typename HAL>
+void SX1276<HAL>::writeRegs (uint8_t addr, const uint8_t *values, uint8_t count) {
+    HAL::select();
+    HAL::transfer(addr | 0x80);
+    HAL::transfer(values, 0, count);
+    HAL::release();
 }
 
-void SPIDeviceBase::writeBuf (uint8_t addr, const uint8_t * buf, uint8_t len) {
-    hal_pin_nss(0);
-    hal_spi_transfer(addr | 0x80);
-    for (uint8_t i=0; i<len; i++) {
-        hal_spi_transfer(buf[i]);
-    }
-    hal_pin_nss(1);
+template<typename HAL>
+void SX1276<HAL>::readRegs (uint8_t addr, uint8_t *values, uint8_t count) {
+    HAL::select();
+    HAL::transfer(addr & 0x7F);
+    HAL::transfer(0, values, count);
+    HAL::release();
 }
 
-void SPIDeviceBase::readBuf (uint8_t addr, uint8_t * buf, uint8_t len) {
-    hal_pin_nss(0);
-    hal_spi_transfer(addr & 0x7F);
-    for (uint8_t i=0; i<len; i++) {
-        buf[i] = hal_spi_transfer(0x00);
-    }
-    hal_pin_nss(1);
-}
-
-
-
 // get random seed from wideband noise rssi
-void SX1276_Base::init () {
+template<typename HAL>
+void SX1276<HAL>::init () {
     // manually reset radio
-    hal_pin_rst(0); // drive RST pin low
-    hal_delay_us(500);   // wait >=100us
-    hal_pin_rst(1); // drive RST pin high
-    hal_delay_us(10000);   // wait >=5ms
+    HAL::pin_rst(0); // drive RST pin low
+    HAL::delay_us(500);   // wait >=100us
+    HAL::pin_rst(1); // drive RST pin high
+    HAL::delay_us(10000);   // wait >=5ms
+
+    _opmode = readReg(RegOpMode);
 
     setupLoRa(ModemSettings()); // setup LoRa with the default modem settings
 
-    writeReg(LORARegFifoRxBaseAddr, 0);
-    writeReg(LORARegFifoTxBaseAddr, 0);
+    const uint8_t fifo_base[] = { 0, 0 };   // TX and RX base address
+    writeRegs(LORARegFifoTxBaseAddr, fifo_base, 2);
     writeReg(RegPaRamp, (readReg(RegPaRamp) & 0xF0) | 0x08); // set PA ramp-up time 50 uSec
 
     // set max payload size
@@ -94,57 +78,55 @@ void SX1276_Base::init () {
     setMode(eMODE_STDBY);
 }
 
-bool SX1276_Base::checkVersion() {
+template<typename HAL>
+bool SX1276<HAL>::checkVersion() {
     // some sanity checks, e.g., read version number
     uint8_t v = readReg(RegVersion);
     return (v == 0x12); // SX1272: (v == 0x22);
 }
 
-void SX1276_Base::setMode (mode_t mode) {
-    uint8_t u = readReg(RegOpMode) & ~OPMODE_MODE_MASK;
-    u |= mode;
-    writeReg(RegOpMode, u);
+template<typename HAL>
+void SX1276<HAL>::setMode (mode_t mode) {
+    _opmode = (_opmode & ~OPMODE_MODE_MASK) | mode;
+    writeReg(RegOpMode, _opmode);
 }
 
-void SX1276_Base::setLRMode (lr_mode_t lr_mode) {
-    uint8_t u = readReg(RegOpMode) & 0xF8;
-    writeReg(RegOpMode, u);
+template<typename HAL>
+void SX1276<HAL>::setLRMode (lr_mode_t lr_mode) {
+    // LongRangeMode can only be changed in sleep mode
+    _opmode &= 0xF8;
+    writeReg(RegOpMode, _opmode);
 
     // We only keep the LowFreq setting and force sleep mode (0)
-    u &= OPMODE_LOWFREQ;
-    u |= ((uint8_t)lr_mode) << 7;
-    writeReg(RegOpMode, u);
+    _opmode &= OPMODE_LOWFREQ;
+    _opmode |= ((uint8_t)lr_mode) << 7;
+    writeReg(RegOpMode, _opmode);
 }
 
-void SX1276_Base::setFrequencyHz (uint32_t frequency) {
+template<typename HAL>
+void SX1276<HAL>::setFrequencyHz (uint32_t frequency) {
     // set frequency: FQ = (FRF * F_XOSC_HZ) / (2 ^ 19)
     uint32_t frf = ((uint64_t)frequency << 19) / F_XOSC_HZ;
-    writeReg(RegFrfMsb, (uint8_t)(frf>>16));
-    writeReg(RegFrfMid, (uint8_t)(frf>> 8));
-    writeReg(RegFrfLsb, (uint8_t)(frf>> 0));
+    const uint8_t frf_regs[] = { (uint8_t)(frf>>16), (uint8_t)(frf>> 8), (uint8_t)(frf>> 0) };
+    writeRegs(RegFrfMsb, frf_regs, 3);
 
-    uint8_t opmode = readReg(RegOpMode) & ~OPMODE_LOWFREQ;
+    uint8_t opmode = _opmode & ~OPMODE_LOWFREQ;
     if (frequency < THRESHOLD_LOWFREQ_HZ) {
         opmode |= OPMODE_LOWFREQ;
     }
-    writeReg(RegOpMode, opmode);
+    if (opmode != _opmode) {
+        _opmode = opmode;
+        writeReg(RegOpMode, _opmode);
+    }
 }
 
-void SX1276_Base::setFrequencyMHz (float frequency) {
-    // set frequency: FQ = (FRF * F_XOSC_HZ) / (2 ^ 19)
-    uint32_t frf = (0.5f + frequency * (524288.0f * 1E6f / F_XOSC_HZ));
-    writeReg(RegFrfMsb, (uint8_t)(frf>>16));
-    writeReg(RegFrfMid, (uint8_t)(frf>> 8));
-    writeReg(RegFrfLsb, (uint8_t)(frf>> 0));
-
-    uint8_t opmode = readReg(RegOpMode) & ~OPMODE_LOWFREQ;
-    if (frequency < THRESHOLD_LOWFREQ_HZ / 1E6f) {
-        opmode |= OPMODE_LOWFREQ;
-    }
-    writeReg(RegOpMode, opmode);
+template<typename HAL>
+void SX1276<HAL>::setFrequencyMHz (float frequency) {
+    setFrequencyHz((uint32_t)(0.5f + frequency * 1E6f));
 }
 
-void SX1276_Base::setPABoost(bool enabled) {
+template<typename HAL>
+void SX1276<HAL>::setPABoost(bool enabled) {
     uint8_t u = readReg(RegPaConfig) & ~PACONFIG_PA_BOOST;
     if (enabled) {
         u |= PACONFIG_PA_BOOST;
@@ -152,7 +134,8 @@ void SX1276_Base::setPABoost(bool enabled) {
     writeReg(RegPaConfig, u);    
 }
 
-void SX1276_Base::setTXPower (int8_t power_dbm) {
+template<typename HAL>
+void SX1276<HAL>::setTXPower (int8_t power_dbm) {
     uint8_t paConfig = readReg(RegPaConfig) & PACONFIG_PA_BOOST;
 
     if (paConfig & PACONFIG_PA_BOOST) {
@@ -183,14 +166,15 @@ void SX1276_Base::setTXPower (int8_t power_dbm) {
     writeReg(RegPaConfig, paConfig);
 }
 
-void SX1276_Base::setupLoRa(const ModemSettings &ms) {
+template<typename HAL>
+void SX1276<HAL>::setupLoRa(const ModemSettings &ms) {
     setLRMode(eLR_MODE_LORA);   // force sleep mode
 
-    //setupLoRa(ms.spreading_factor, ms.bandwidth, ms.coding_rate);
-    //uint8_t cfg1 = readReg(LORARegModemSettings1) & ~(LORA_CONFIG1_CR_MASK | LORA_CONFIG1_BW_MASK | LORA_CONFIG1_IMPLICIT_HEADER);
+    // ModemConfig1, ModemConfig2, SymbTimeoutLsb and the preamble length are
+    // consecutive registers, written in one burst
     uint8_t cfg1 = 0;
-    uint8_t cfg2 = readReg(LORARegModemConfig2) & ~(LORA_CONFIG2_SF_MASK | LORA_CONFIG2_CRC_ON);
-    uint8_t cfg3 = readReg(LORARegModemConfig3) & ~(LORA_CONFIG3_LOW_DATA_RATE); //  LORA_CONFIG3_AGC_ON
+    uint8_t cfg2 = 0;
+    uint8_t cfg3 = 0;   //  LORA_CONFIG3_AGC_ON
 
     cfg1 |= (uint8_t)ms.coding_rate << LORA_CONFIG1_CR_SHIFT;
     cfg1 |= (uint8_t)ms.bandwidth << LORA_CONFIG1_BW_SHIFT;
@@ -203,40 +187,45 @@ void SX1276_Base::setupLoRa(const ModemSettings &ms) {
         cfg2 |= LORA_CONFIG2_CRC_ON;
     }
 
-    if (((ms.spreading_factor == eSF_11 || ms.spreading_factor == eSF_12) && ms.bandwidth == eBW_125k) ||
-         (ms.spreading_factor == eSF_12 && ms.bandwidth == eBW_250k)) 
-    {
+    if (ms.lowDataRate()) {
         cfg3 |= LORA_CONFIG3_LOW_DATA_RATE;
     }
     //cfg3 |= LORA_CONFIG3_AGC_ON;
 
-    writeReg(LORARegModemConfig1, cfg1);
-    writeReg(LORARegModemConfig2, cfg2);
+    const uint8_t modem_regs[] = {
+        cfg1,                                   // LORARegModemConfig1
+        cfg2,                                   // LORARegModemConfig2 (SymbTimeoutMsb = 0)
+        0x64,                                   // LORARegSymbTimeoutLsb (default)
+        (uint8_t)(ms.preamble_length >> 8),     // LORARegPreambleMsb
+        (uint8_t)(ms.preamble_length >> 0)      // LORARegPreambleLsb
+    };
+    writeRegs(LORARegModemConfig1, modem_regs, sizeof(modem_regs));
     writeReg(LORARegModemConfig3, cfg3);
 
+    // Upper bits of DetectOptimize keep their reset value (0xC0)
     if (ms.spreading_factor == eSF_6) {
-        uint8_t u = readReg(LORARegDetectOptimize) & ~LORA_DETECTIONOPTIMIZE_MASK;
-        writeReg(LORARegDetectOptimize, u | LORA_DETECTIONOPTIMIZE_SF6);
+        writeReg(LORARegDetectOptimize, 0xC0 | LORA_DETECTIONOPTIMIZE_SF6);
         writeReg(LORARegDetectionThreshold, LORA_DETECTIONTHRESH_SF6);
     }
     else {
-        uint8_t u = readReg(LORARegDetectOptimize) & ~LORA_DETECTIONOPTIMIZE_MASK;
-        writeReg(LORARegDetectOptimize, u | LORA_DETECTIONOPTIMIZE_SF7_TO_SF12);
+        writeReg(LORARegDetectOptimize, 0xC0 | LORA_DETECTIONOPTIMIZE_SF7_TO_SF12);
         writeReg(LORARegDetectionThreshold, LORA_DETECTIONTHRESH_SF7_TO_SF12);
     }
 
-    writeReg(LORARegPreambleLsb, (uint8_t)(ms.preamble_length >> 0));
-    writeReg(LORARegPreambleMsb, (uint8_t)(ms.preamble_length >> 8));
     writeReg(LORARegSyncWord, ms.sync_word);
+
+    _modem = ms;
 }
 
-void SX1276_Base::setupFSK() {
+template<typename HAL>
+void SX1276<HAL>::setupFSK() {
     setLRMode(eLR_MODE_FSK);   // force sleep mode
 
     writeReg(FSKRegPacketConfig2, 0);
 }
 
-void SX1276_Base::writeFIFO(const uint8_t *data, uint8_t length) {
+template<typename HAL>
+void SX1276<HAL>::writeFIFO(const uint8_t *data, uint8_t length) {
     // enter standby mode (required for LoRa FIFO loading)
     setMode(eMODE_STDBY);
 
@@ -247,20 +236,24 @@ void SX1276_Base::writeFIFO(const uint8_t *data, uint8_t length) {
 #endif
     writeReg(LORARegFifoAddrPtr, 0);
 
-    // Write message data
-
+    // Write headers and message data in a single burst
+    HAL::select();
+    HAL::transfer(RegFifo | 0x80);
 #ifdef RADIOHEAD_COMPATIBLE
-    // The headers
-    writeReg(RegFifo, 0xFF);    // to:      broadcast
-    writeReg(RegFifo, 0xFF);    // from:    broadcast
-    writeReg(RegFifo, 0x00);    // id:      0
-    writeReg(RegFifo, 0x00);    // flags:   0
+    const uint8_t header[] = {
+        0xFF,       // to:      broadcast
+        0xFF,       // from:    broadcast
+        0x00,       // id:      0
+        0x00        // flags:   0
+    };
+    HAL::transfer(header, 0, sizeof(header));
 #endif
-
-    writeBuf(RegFifo, data, length);
+    HAL::transfer(data, 0, length);
+    HAL::release();
 }
 
-void SX1276_Base::readFIFO(uint8_t *data, uint8_t &length) {
+template<typename HAL>
+void SX1276<HAL>::readFIFO(uint8_t *data, uint8_t &length) {
     // The PayloadCrcError flag should be checked for packet integrity.
     // In order to retrieve received data from FIFO the user must ensure that  
     // ValidHeader, PayloadCrcError, RxDone and RxTimeout interrupts in the 
@@ -270,31 +263,41 @@ void SX1276_Base::readFIFO(uint8_t *data, uint8_t &length) {
     // Position at the beginning of the FIFO
     writeReg(LORARegFifoAddrPtr, readReg(LORARegFifoRxCurrentAddr));
     uint8_t n_recv = readReg(LORARegRxNbBytes);
+#ifdef RADIOHEAD_COMPATIBLE
+    // Skip the headers (to, from, id, flags)
+    uint8_t header[4];
+    if (n_recv < sizeof(header)) {
+        length = 0;
+        return;
+    }
+    readRegs(RegFifo, header, sizeof(header));
+    n_recv -= sizeof(header);
+#endif
     // Read message data
     if (n_recv <= length) length = n_recv;
-    readBuf(RegFifo, data, length);
+    readRegs(RegFifo, data, length);
 }
 
-void SX1276_Base::startTX() {
-    uint8_t u = readReg(RegOpMode) & 0x80;
-    if ((lr_mode_t)(u >> 7) == eLR_MODE_LORA) {
+template<typename HAL>
+void SX1276<HAL>::startTX() {
+    if ((lr_mode_t)(_opmode >> 7) == eLR_MODE_LORA) {
         // set the IRQ mapping DIO0=TxDone DIO1=NOP DIO2=NOP
         writeReg(RegDioMapping1, MAP_DIO0_LORA_TXDONE|MAP_DIO1_LORA_NOP|MAP_DIO2_LORA_NOP);
-        // clear all radio IRQ flags
-        writeReg(LORARegIrqFlags, 0xFF);
-        // mask all IRQs but TxDone
-        writeReg(LORARegIrqFlagsMask, ~IRQ_LORA_TXDONE_MASK);
+        // mask all IRQs but TxDone, clear all radio IRQ flags
+        const uint8_t irq_regs[] = { (uint8_t)~IRQ_LORA_TXDONE_MASK, 0xFF };
+        writeRegs(LORARegIrqFlagsMask, irq_regs, 2);
     }
 
     // enable antenna switch for TX
-    hal_pin_rxtx(1);
+    HAL::pin_rxtx(1);
 
     setMode(eMODE_TX); // Start the transmitter
     // Datasheet: Upon completion the TxDone interrupt is issued and the radio returns to Standby mode.
 }
 
 // start LoRa receiver (time=LMIC.rxtime, timeout=LMIC.rxsyms, result=LMIC.frame[LMIC.dataLen])
-void SX1276_Base::startRX () {
+template<typename HAL>
+void SX1276<HAL>::startRX () {
     // enter standby mode (warm up))
     setMode(eMODE_STDBY);
 
@@ -311,13 +314,13 @@ void SX1276_Base::startRX () {
 
     // configure DIO mapping DIO0=RxDone DIO1=RxTout DIO2=NOP
     writeReg(RegDioMapping1, MAP_DIO0_LORA_RXDONE|MAP_DIO1_LORA_RXTOUT|MAP_DIO2_LORA_NOP);
-    // clear all radio IRQ flags
-    writeReg(LORARegIrqFlags, 0xFF);
-    // enable required radio IRQs
-    writeReg(LORARegIrqFlagsMask, ~IRQ_LORA_RXDONE_MASK);   // IRQ_LORA_RXTOUT_MASK
+    // enable required radio IRQs (PayloadCrcError is only reported along with
+    // RxDone if it is unmasked), clear all radio IRQ flags
+    const uint8_t irq_regs[] = { (uint8_t)~(IRQ_LORA_RXDONE_MASK|IRQ_LORA_CRCERR_MASK), 0xFF };  // IRQ_LORA_RXTOUT_MASK
+    writeRegs(LORARegIrqFlagsMask, irq_regs, 2);
 
     // enable antenna switch for RX
-    hal_pin_rxtx(0);
+    HAL::pin_rxtx(0);
 
     setMode(eMODE_RX); 
     // Datasheet: In continuous RX mode, opposite to the single RX mode,
@@ -325,27 +328,45 @@ void SX1276_Base::startRX () {
     // and the device will never go in Standby mode automatically. 
 }
 
-void SX1276_Base::sleep() {
+template<typename HAL>
+void SX1276<HAL>::sleep() {
     setMode(eMODE_SLEEP);
 }
 
-int8_t SX1276_Base::getRSSI () {
+template<typename HAL>
+int8_t SX1276<HAL>::getRSSI () {
     int8_t r = readReg(LORARegRssiValue) - 157; // -164 in LF
     return r;
 }
 
-int8_t SX1276_Base::getPacketRSSI () {
+template<typename HAL>
+int8_t SX1276<HAL>::getPacketRSSI () {
     int8_t r = readReg(LORARegPktRssiValue) - 157;  // -164 in LF
     return r;
 }
 
-int8_t SX1276_Base::getPacketSNR () {
-    int8_t r = readReg(LORARegPktSnrValue) / 4;
+template<typename HAL>
+int8_t SX1276<HAL>::getPacketSNR () {
+    int8_t r = (int8_t)readReg(LORARegPktSnrValue) / 4;  // two's complement, dB x 4
     return r;
 }
 
-uint8_t SX1276_Base::getIRQFlags () {
-    readReg(LORARegIrqFlags);
+template<typename HAL>
+uint8_t SX1276<HAL>::getIRQFlags () {
+    return readReg(LORARegIrqFlags);
+}
+
+template<typename HAL>
+uint32_t SX1276<HAL>::timeOnAirUs (uint8_t length) {
+    return timeOnAirUs(length, _modem);
+}
+
+template<typename HAL>
+uint32_t SX1276<HAL>::timeOnAirUs (uint8_t length, const ModemSettings &settings) {
+#ifdef RADIOHEAD_COMPATIBLE
+    length += 4;
+#endif
+    return settings.timeOnAirUs(length);
 }
 
 // const uint16_t SX1276_Base::LORA_RXDONE_FIXUP[] = {
@@ -360,31 +381,24 @@ uint8_t SX1276_Base::getIRQFlags () {
 
 // called by hal ext IRQ handler
 // (radio goes to stanby mode after tx/rx operations)
-void SX1276_Base::handleIRQ() {
+template<typename HAL>
+uint8_t SX1276<HAL>::handleIRQ() {
     uint8_t flags = readReg(LORARegIrqFlags);
-    // mask all radio IRQs
-    writeReg(LORARegIrqFlagsMask, 0xFF);
-    // clear radio IRQ flags
-    writeReg(LORARegIrqFlags, 0xFF);
+    // mask all radio IRQs, clear radio IRQ flags
+    const uint8_t irq_regs[] = { 0xFF, 0xFF };
+    writeRegs(LORARegIrqFlagsMask, irq_regs, 2);
 
     // go from stanby to sleep
     //setMode(eMODE_SLEEP);
 
-    if (flags & IRQ_LORA_TXDONE_MASK) {
-        onTXDone();
-    }
-    if (flags & IRQ_LORA_RXDONE_MASK) {
-        onRXDone();
-        // dataLen_ = (readReg(LORARegModemSettings1) & SX1272_MC1_IMPLICIT_HEADER_MODE_ON) ?
-        //     readReg(LORARegPayloadLength) : readReg(LORARegRxNbBytes);
-        // // set FIFO read address pointer
-        // writeReg(LORARegFifoAddrPtr, readReg(LORARegFifoRxCurrentAddr)); 
-        // // now read the FIFO
-        // readBuf(RegFifo, frame_, dataLen_);
-    }
-    if (flags & IRQ_LORA_RXTOUT_MASK) {
-        onRXTimeout();
-    }
+    // if (flags & IRQ_LORA_RXDONE_MASK) {
+    //     dataLen_ = (readReg(LORARegModemSettings1) & SX1272_MC1_IMPLICIT_HEADER_MODE_ON) ?
+    //         readReg(LORARegPayloadLength) : readReg(LORARegRxNbBytes);
+    //     // set FIFO read address pointer
+    //     writeReg(LORARegFifoAddrPtr, readReg(LORARegFifoRxCurrentAddr)); 
+    //     // now read the FIFO
+    //     readBuf(RegFifo, frame_, dataLen_);
+    // }
 
     // else { // FSK modem
     //     uint8_t flags1 = readReg(FSKRegIrqFlags1);
@@ -407,18 +421,7 @@ void SX1276_Base::handleIRQ() {
     //         //while(1);
     //     }
     // }
-}
-
-void SX1276_Base::onTXDone() {
-
-}
-
-void SX1276_Base::onRXDone() {
-
-}
-
-void SX1276_Base::onRXTimeout() {
-
+    return flags;
 }
 
 // void SX1276_Base::seedRandom() {
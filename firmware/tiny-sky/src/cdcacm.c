@@ -18,6 +18,7 @@
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/syscfg.h>
@@ -36,51 +37,68 @@
 #define CRITICAL_START { uint8_t irq_state___ = nvic_get_irq_enabled(NVIC_USB_IRQ); nvic_disable_irq(NVIC_USB_IRQ);
 #define CRITICAL_END   if (irq_state___) nvic_enable_irq(NVIC_USB_IRQ); }
 
-#define QUEUE_SIZE 128
+#define QUEUE_SIZE 128     // must be a power of two
+#define QUEUE_MASK (QUEUE_SIZE - 1)
 
+// Single producer, single consumer ring (same scheme as ptlib Queue).
+// Head is only written by the producer and tail only by the consumer, so the
+// USB interrupt and the main loop can share a queue without masking the IRQ.
 typedef struct {
-  uint32_t  _size;
-  uint32_t  _head;
+  volatile uint32_t _head;
+  volatile uint32_t _tail;
   uint8_t   _buffer[QUEUE_SIZE];
 } queue_t;
 
+#define Q_LOAD(x)       __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define Q_STORE(x, v)   __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+
 static void q_clear(queue_t *q) {
-	q->_size = 0;
 	q->_head = 0;
+	q->_tail = 0;
 }
 
-static uint8_t q_push(queue_t *q, uint8_t item) {
-	if (q->_size < QUEUE_SIZE) {
-		uint32_t tail = q->_head + q->_size;
-		if (tail >= QUEUE_SIZE) tail -= QUEUE_SIZE;
-		q->_buffer[tail] = item;
-		q->_size++;      
-		return 1;
+static uint32_t q_push_n(queue_t *q, const uint8_t *items, uint32_t count) {
+	uint32_t head = q->_head;
+	uint32_t space = QUEUE_SIZE - (head - Q_LOAD(q->_tail));
+	if (count > space) count = space;
+	for (uint32_t i = 0; i < count; i++) {
+		q->_buffer[(head + i) & QUEUE_MASK] = items[i];
 	}
-	return 0;
+	Q_STORE(q->_head, head + count);
+	return count;
 }
 
-static uint8_t q_pop(queue_t *q, uint8_t *item) {
-	if (q->_size > 0) {
-		*item = q->_buffer[q->_head];
-		q->_head++;
-		if (q->_head == QUEUE_SIZE) q->_head = 0;
-		q->_size--;
-		return 1;
+static uint32_t q_pop_n(queue_t *q, uint8_t *items, uint32_t count) {
+	uint32_t tail = q->_tail;
+	uint32_t used = Q_LOAD(q->_head) - tail;
+	if (count > used) count = used;
+	for (uint32_t i = 0; i < count; i++) {
+		items[i] = q->_buffer[(tail + i) & QUEUE_MASK];
 	}
-	return 0;
+	Q_STORE(q->_tail, tail + count);
+	return count;
 }
 
 static uint32_t q_used(const queue_t *q) {
-	return q->_size;
+	return Q_LOAD(q->_head) - Q_LOAD(q->_tail);
 }
 
 static uint32_t q_free(const queue_t *q) {
-	return QUEUE_SIZE - q->_size;
+	return QUEUE_SIZE - q_used(q);
 }
 
 static queue_t rx_queue;
-static queue_t tx_queue;
+
+// Transmit side is double buffered in whole packets: the main loop copies data
+// into the fill buffer while the other one (if complete) waits for the IN
+// endpoint. usbd_ep_write_packet() copies into USB packet memory right away,
+// so a buffer is free again as soon as it has been handed to the endpoint.
+#define TX_PACKET_SIZE  64
+
+static uint8_t tx_packet[2][TX_PACKET_SIZE] __attribute__ ((aligned(4)));
+static volatile uint8_t tx_len[2];
+static volatile uint8_t tx_fill;     // buffer currently filled by usb_cdc_write()
+static volatile uint8_t tx_busy;     // a packet is in flight on the IN endpoint
 
 
 static const struct usb_device_descriptor dev = {
@@ -269,46 +287,41 @@ static void cdcacm_data_rx_cb(usbd_device *usbd_dev, uint8_t ep)
 	int len = usbd_ep_read_packet(usbd_dev, 0x01, buf, 64);
 
 	if (len) {
-		char *ptr = buf;
-		while (len > 0) {
-			if (!q_push(&rx_queue, *ptr)) break;
-			ptr++;
-			len--;
-		}
+		q_push_n(&rx_queue, (const uint8_t *)buf, len);
 		//while (usbd_ep_write_packet(usbd_dev, 0x82, buf, len) == 0);
 	}
 }
 
-static volatile uint8_t tx_done;
-
-static void cdcacm_data_tx_cb(usbd_device *usbd_dev, uint8_t ep)
+// Hand the next pending packet to the IN endpoint. Called either from the 
+// endpoint callback or with the USB interrupt masked.
+static void cdcacm_tx_next(usbd_device *usbd_dev)
 {
-	(void)ep;
-	//if (!cdc_configured) return;
-
-	unsigned len = 0;
-	uint8_t buf[32] __attribute__ ((aligned(4)));
-
-	CRITICAL_START {
-		uint8_t *buf_ptr = buf;
-		while (len < 32 && q_pop(&tx_queue, buf_ptr)) {
-			buf_ptr++;
-			len++;
-		}
-	} CRITICAL_END
+	// A complete packet waiting in the other buffer goes first
+	uint8_t idx = tx_fill ^ 1;
+	if (tx_len[idx] == 0) idx = tx_fill;
 
 	// For some reason VCP misses characters when we send ZLP (zero length packets)
-	if (len > 0) {
+	if (tx_len[idx] > 0) {
 		// So we avoid it
-		usbd_ep_write_packet(usbd_dev, 0x82, buf, len);
+		usbd_ep_write_packet(usbd_dev, 0x82, tx_packet[idx], tx_len[idx]);
+		tx_len[idx] = 0;
+		tx_busy = 1;
 	}
 	else {
 		// Only after we have received a callback and there was no new data to be sent, 
 		// we can declare that TX is complete. 
-		tx_done = 1;
+		tx_busy = 0;
 	}
 }
 
+static void cdcacm_data_tx_cb(usbd_device *usbd_dev, uint8_t ep)
+{
+	(void)ep;
+	//if (!cdc_configured) return;
+
+	cdcacm_tx_next(usbd_dev);
+}
+
 static void cdcacm_set_config(usbd_device *usbd_dev, uint16_t wValue)
 {
 	(void)wValue;
@@ -324,6 +337,8 @@ static void cdcacm_set_config(usbd_device *usbd_dev, uint16_t wValue)
 				USB_REQ_TYPE_TYPE | USB_REQ_TYPE_RECIPIENT,
 				cdcacm_control_request);
 
+	tx_len[0] = tx_len[1] = 0;
+	tx_busy = 0;
 	cdc_configured = 1;
 }
 
@@ -347,9 +362,10 @@ void usb_setup() {
 	rcc_periph_clock_enable(RCC_GPIOA);
 	rcc_periph_clock_enable(RCC_USB);
 
-	q_clear(&tx_queue);
 	q_clear(&rx_queue);
-	tx_done = 1;
+	tx_len[0] = tx_len[1] = 0;
+	tx_fill = 0;
+	tx_busy = 0;
 
 	usbd_dev = usbd_init(&st_usbfs_v2_usb_driver, &dev, &config,
 			usb_strings, 3,
@@ -373,18 +389,32 @@ static int usb_cdc_write_blocking(const uint8_t *buf, int len) {
 }
 
 static int usb_cdc_write_queue(const uint8_t *buf, int len) {
-	CRITICAL_START 
-		while (len) {
-			if (!q_push(&tx_queue, *buf)) break;
-			buf++;
-			len--;
+	int n_written = 0;
+	while (len > 0) {
+		int chunk = 0;
+		// Take the lock once per chunk (at most a packet), not per byte
+		CRITICAL_START
+		uint8_t fill = tx_fill;
+		if (tx_len[fill] == TX_PACKET_SIZE && tx_len[fill ^ 1] == 0) {
+			// Fill buffer is complete and waits for the endpoint, switch to the other one
+			fill ^= 1;
+			tx_fill = fill;
 		}
-	CRITICAL_END
-	if (tx_done) {
-		tx_done = 0;
-		cdcacm_data_tx_cb(usbd_dev, 0x82);
+		chunk = TX_PACKET_SIZE - tx_len[fill];
+		if (chunk > len) chunk = len;
+		memcpy(tx_packet[fill] + tx_len[fill], buf, chunk);
+		tx_len[fill] += chunk;
+		if (!tx_busy) {
+			// Endpoint is idle, so no IN callback will come to pick the data up
+			cdcacm_tx_next(usbd_dev);
+		}
+		CRITICAL_END
+		if (chunk == 0) break;      // both buffers full, the host is not keeping up
+		buf += chunk;
+		len -= chunk;
+		n_written += chunk;
 	}
-	return 0;
+	return n_written;
 }
 
 int usb_cdc_write(const uint8_t *buf, int len) {
@@ -396,14 +426,12 @@ int usb_cdc_write(const uint8_t *buf, int len) {
 int usb_cdc_read(uint8_t *buf, int len) {
 	//if (len > 64) len = 64;
 	//return usbd_ep_read_packet(usbd_dev, 0x01, buf, len);
-	int n_read = 0;
-	while (len > 0) {
-		if (!q_pop(&rx_queue, buf)) break;
-		n_read++;
-		len--;
-		buf++;
-	}
-	return n_read;
+	if (len <= 0) return 0;
+	return q_pop_n(&rx_queue, buf, len);
+}
+
+int usb_cdc_connected() {
+	return cdc_configured;
 }
 
 void usb_poll() {
@@ -6,4 +6,5 @@ void usb_setup();
 void usb_poll();
 void usb_enable_interrupts();
 int usb_cdc_write(const uint8_t *buf, int len);
-int usb_cdc_read(uint8_t *buf, int len);
\ No newline at end of file
+int usb_cdc_read(uint8_t *buf, int len);
+int usb_cdc_connected();
\ No newline at end of file
@@ -5,6 +5,11 @@
 #include "systick.h"
 #include "ublox.h"
 #include "strconv.h"
+#include "crc.h"
+#include "lfs_flash.h"
+#include "radio.h"
+
+#include <lora/telemetry_frame.h>
 
 extern "C" {
 #include "cdcacm.h"
@@ -13,6 +18,7 @@ extern "C" {
 #include <cstring>
 #include <cstdio>
 #include <cstdarg>
+#include <cstdlib>
 
 void print(char c) {
     usb_cdc_write((const uint8_t *) &c, 1);
@@ -29,12 +35,77 @@ void print(const char *format, ...) {
     usb_cdc_write((const uint8_t *) str, strlen(str));
 }
 
+// Like print(), but waits for room in the USB transmit buffers instead of
+// dropping what does not fit (for bulk dumps). Fails if the host stops reading.
+static bool print_all(const uint8_t *buf, int len) {
+    systime_t last_progress = millis();
+    while (len > 0) {
+        int n_written = usb_cdc_write(buf, len);
+        if (n_written < 0) return false;
+        if (n_written > 0) {
+            last_progress = millis();
+        }
+        else if (millis() - last_progress > 1000) {
+            return false;
+        }
+        buf += n_written;
+        len -= n_written;
+        // idle wait
+    }
+    return true;
+}
+
+// Binary log download. The log is streamed as a sequence of frames
+//   'X' 'L' type offset[4] length[2] payload[length] crc32[4]
+// (little endian, CRC over type..payload). Data frames ('D') carry up to 256
+// bytes each and the transfer ends with an 'E' frame whose offset field holds
+// the total log size. After an error the host resumes by requesting the first 
+// offset it has not received intact.
+static void dump_log(uint32_t offset, uint32_t length) {
+    const int max_block = 256;
+    uint8_t frame[9 + max_block + 4];
+
+    uint32_t log_size = xlog_used_space();
+    if (offset > log_size) offset = log_size;
+    if (length == 0 || length > log_size - offset) length = log_size - offset;
+    uint32_t end = offset + length;
+
+    while (true) {
+        int size = (end - offset > max_block) ? max_block : (end - offset);
+        if (size > 0) size = xlog_read(offset, frame + 9, size);
+
+        uint32_t frame_offset = (size > 0) ? offset : log_size;
+        frame[0] = 'X';
+        frame[1] = 'L';
+        frame[2] = (size > 0) ? 'D' : 'E';
+        frame[3] = (uint8_t)(frame_offset >> 0);
+        frame[4] = (uint8_t)(frame_offset >> 8);
+        frame[5] = (uint8_t)(frame_offset >> 16);
+        frame[6] = (uint8_t)(frame_offset >> 24);
+        frame[7] = (uint8_t)(size >> 0);
+        frame[8] = (uint8_t)(size >> 8);
+
+        uint32_t crc = crc32_update(0, frame + 2, 7 + size);
+        uint8_t *tail = frame + 9 + size;
+        tail[0] = (uint8_t)(crc >> 0);
+        tail[1] = (uint8_t)(crc >> 8);
+        tail[2] = (uint8_t)(crc >> 16);
+        tail[3] = (uint8_t)(crc >> 24);
+
+        if (!print_all(frame, 9 + size + 4)) break;
+        if (size == 0) break;
+        offset += size;
+    }
+}
+
 
 void gps_send(uint8_t c) {
     // if (nmeaTXBuffer.push(c)) {
     //     usart_gps.enableTXInterrupt();
     // }
-    gState.usart_gps.putc(c);
+    while (!gState.usart_gps.putc(c)) {
+        // idle wait
+    }
 }
 
 void gps_send(const uint8_t *buf, int length) {
@@ -145,12 +216,49 @@ void query_lora() {
     print('\n');
 }
 
+void query_radio() {
+    const RadioStats &stats = radio_stats();
+    print("Radio: %s, %d queued (%ld ms), budget %ld ms\n", radio_busy() ? "TX" : "idle", 
+        radio_queued(), radio_backlog_ms(), radio_budget_ms());
+    print("  Sent %ld, dropped %ld, refused %ld, late %ld, timeouts %ld\n", 
+        stats.frames_sent, stats.frames_dropped, stats.frames_refused, stats.frames_late, stats.tx_timeouts);
+    print("  Airtime %ld ms total, %d ms last (%d ms expected), %d ms max\n", 
+        stats.airtime_total, stats.airtime_last, stats.airtime_expected, stats.airtime_max);
+    const RFM96::ModemSettings ms = radio_rate_settings(radio_rate());
+    print("  Rate %d (SF%d, %d kHz)%s, %ld link reports\n", radio_rate(), ms.spreading_factor,
+        500 / ms.bandwidthDivider(), gSettings.radio_adaptive ? " adaptive" : "", stats.reports_received);
+    if (stats.reports_received) {
+        print("  Downlink SNR %d dB, RSSI %d dBm; uplink SNR %d dB, RSSI %d dBm\n",
+            stats.report_snr, stats.report_rssi, stats.uplink_snr, stats.uplink_rssi);
+    }
+}
+
 void query_flash() {
-    // if (flash_initialized) {
-    // }
-    // else {
-    //     print("Flash: uninitialized\n");
-    // }
+    SPIFlash &flash = gState.flash;
+    if (flash.chipSize() == 0) {
+        print("Flash: uninitialized\n");
+        return;
+    }
+    print("Flash: %ld KB, page %ld, program %d us%s\n", flash.chipSize() / 1024, 
+        flash.pageSize(), flash.pageProgramTime(), flash.hasDualRead() ? ", dual read" : "");
+    for (int i = 0; i < 4; i++) {
+        const SPIFlash::EraseType &type = flash.eraseType(i);
+        if (type.size == 0) continue;
+        print("  Erase %02Xh: %ld KB, %d ms\n", type.opcode, type.size / 1024, type.time_ms);
+    }
+    print("  Chip erase: %ld ms\n", flash.chipEraseTime());
+}
+
+void query_tasks() {
+    print("Task       runs  late max/avg  overruns\n");
+    for (int i = 0; i < task_count(); i++) {
+        const timer_task_t *task = task_get(i);
+        uint32_t late_avg = (task->run_count > 0) ? (task->late_sum / task->run_count) : 0;
+        print("%-8s %6ld  %5ld/%-5ld  %ld\n", 
+            task->name ? task->name : "?", 
+            task->run_count, task->late_max, late_avg, task->overruns
+        );
+    }
 }
 
 void print_report() {
@@ -164,7 +272,7 @@ void print_report() {
     const GPSParserSimple &gps = gState.gps;
 
     print("GNSS: %4d ", (millis() + 500)/ 1000);
-    print("%d/%d ", gps.sentencesOK(), gps.sentencesErr());
+    print("%d/%d/%ld ", gps.sentencesOK(), gps.sentencesErr(), gState.usart_gps.overruns());
     print("%d/%d ", gps.tracked().value(), gps.inView().value());
 
     if (gps.fixTime().valid()) {
@@ -199,6 +307,54 @@ void print_report() {
     if (gState.telemetry.build_string(packet_data, packet_length)) {
         print("Tele: [%s]\n", packet_data);
     }
+    uint8_t frame_data[TELEMETRY_FRAME_LENGTH];
+    int frame_length = sizeof(frame_data);
+    if (gState.telemetry.build_binary(frame_data, frame_length)) {
+        print("Tele:");
+        for (int i = 0; i < frame_length; i++) print(" %02X", frame_data[i]);
+        print('\n');
+    }
+}
+
+static int count_blocks(void *p, lfs_block_t block) {
+    (*(uint32_t *)p)++;
+    return 0;
+}
+
+// Measures littlefs append throughput with a sync after every 4 KB,
+// the way a filesystem based flight log would be written
+static void lfs_bench() {
+    const int total = 64 * 1024;
+    uint8_t chunk[256];
+    for (int i = 0; i < sizeof(chunk); i++) chunk[i] = i;
+
+    lfs_file_t file;
+    int err = lfs_file_open(&gState.lfs, &file, "bench", LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC);
+    if (err < 0) {
+        print("Open err = %d\n", err);
+        return;
+    }
+
+    systime_t start = millis();
+    systime_t sync_max = 0;
+    for (int written = 0; written < total && err >= 0; written += sizeof(chunk)) {
+        err = lfs_file_write(&gState.lfs, &file, chunk, sizeof(chunk));
+        if (err >= 0 && (written + sizeof(chunk)) % 4096 == 0) {
+            systime_t sync_start = millis();
+            err = lfs_file_sync(&gState.lfs, &file);
+            if (millis() - sync_start > sync_max) sync_max = millis() - sync_start;
+        }
+    }
+    lfs_file_close(&gState.lfs, &file);
+    systime_t elapsed = millis() - start;
+    lfs_remove(&gState.lfs, "bench");
+
+    if (err < 0) {
+        print("Write err = %d\n", err);
+        return;
+    }
+    print("%d bytes in %ld ms (%ld B/s), max sync %ld ms\n", 
+        total, elapsed, (total * 1000UL) / (elapsed ? elapsed : 1), sync_max);
 }
 
 void console_parse(const char *line) {
@@ -252,6 +408,10 @@ void console_parse(const char *line) {
         ublox_set_dyn_mode(eDYN_PEDESTRIAN);
         cmd_ok = true;
     }
+    else if (0 == strcmp(line, "gps_ubx")) {
+        gState.gps_setup_ubx();
+        cmd_ok = true;
+    }
     else if (0 == strcmp(line, "gps_port")) {
         ublox_set_dyn_mode(eDYN_PORTABLE);
         cmd_ok = true;
@@ -259,15 +419,39 @@ void console_parse(const char *line) {
     else if (0 == strcmp(line, "lora_test")) {
         uint8_t test_data[64];
         gState.radio.setTXPower(13);
-        gState.radio.writeFIFO(test_data, sizeof(test_data));
-        gState.radio.startTX();
+        radio_send(test_data, sizeof(test_data));
         cmd_ok = true;
     }
     else if (0 == strcmp(line, "lora_test2")) {
         uint8_t test_data[64];
         gState.radio.setTXPower(23);
-        gState.radio.writeFIFO(test_data, sizeof(test_data));
-        gState.radio.startTX();
+        radio_send(test_data, sizeof(test_data));
+        cmd_ok = true;
+    }
+    else if (0 == strcmp(line, "radio")) {
+        query_radio();
+        cmd_ok = true;
+    }
+    else if (0 == strcmp(line, "radio_rst")) {
+        radio_stats_reset();
+        cmd_ok = true;
+    }
+    else if (0 == strcmp(line, "radio_adapt")) {
+        gSettings.radio_adaptive = 1;
+        radio_set_adaptive(true);
+        cmd_ok = true;
+    }
+    else if (0 == strcmp(line, "radio_fixed")) {
+        gSettings.radio_adaptive = 0;
+        radio_set_adaptive(false);
+        cmd_ok = true;
+    }
+    else if (0 == strcmp(line, "tasks")) {
+        query_tasks();
+        cmd_ok = true;
+    }
+    else if (0 == strcmp(line, "tasks_rst")) {
+        task_stats_reset();
         cmd_ok = true;
     }
     else if (0 == strcmp(line, "mag_cal")) {
@@ -277,27 +461,39 @@ void console_parse(const char *line) {
         cmd_ok = true;
     }
     else if (0 == strcmp(line, "ls")) {
-        // print("Files in /\n");
-        // lfs_dir_t dir;
-        // int err;
-
-        // err = lfs_dir_open(&gState.lfs, &dir, "");
-        // if (err < 0) {
-        //     print("Error while opening directory\n");
-        // } else {
-        //     lfs_info info;
-        //     while (lfs_dir_read(&gState.lfs, &dir, &info) > 0) {
-        //         if (info.type == LFS_TYPE_REG) {
-        //             print("  %s   [%ld]\n", info.name, info.size);
-        //         }
-        //         else {
-        //             print("  %s/\n", info.name);
-        //         }
-        //     }
-        // }
-        // err = lfs_dir_close(&gState.lfs, &dir);
-        // if (err < 0) print("Error while closing directory\n");
+        if (gState.lfs_ok) {
+            print("Files in /\n");
+            lfs_dir_t dir;
+            int err;
+
+            err = lfs_dir_open(&gState.lfs, &dir, "/");
+            if (err < 0) {
+                print("Error while opening directory\n");
+            } else {
+                lfs_info info;
+                while (lfs_dir_read(&gState.lfs, &dir, &info) > 0) {
+                    if (info.type == LFS_TYPE_REG) {
+                        print("  %s   [%ld]\n", info.name, info.size);
+                    }
+                    else {
+                        print("  %s/\n", info.name);
+                    }
+                }
+                err = lfs_dir_close(&gState.lfs, &dir);
+                if (err < 0) print("Error while closing directory\n");
+            }
+            uint32_t n_allocated = 0;
+            lfs_traverse(&gState.lfs, count_blocks, &n_allocated);
+            print("FS blocks used: %ld/%d, mount %ld ms\n", n_allocated, LFS_FLASH_BLOCK_COUNT, gState.lfs_mount_ms);
+        }
+        else {
+            print("No filesystem\n");
+        }
         print("Log: %ld\n", xlog_used_space());
+        print("Dropped: %ld\n", xlog_dropped_records());
+        if (gState.flash.erasing()) {
+            print("Erasing: %ld\n", gState.flash.eraseRemaining());
+        }
 
         int err = xlog_free_space();
         if (err < 0) print("Error while calculating free space\n");
@@ -305,6 +501,16 @@ void console_parse(const char *line) {
 
         cmd_ok = true;        
     }
+    else if (0 == strcmp(line, "flash")) {
+        query_flash();
+        cmd_ok = true;
+    }
+    else if (0 == strcmp(line, "lfs_bench")) {
+        if (gState.lfs_ok) {
+            lfs_bench();
+            cmd_ok = true;
+        }
+    }
     else if (0 == strcmp(line, "save_cal")) {
         int err = gCalibration.save();
         if (err) print("Save err = %d\n", err);
@@ -335,17 +541,30 @@ void console_parse(const char *line) {
         xlog_erase_log();
         cmd_ok = true;
     }
+    else if (0 == strncmp(line, "dump", 4) && (line[4] == ' ' || line[4] == '\0')) {
+        // dump [offset [length]]
+        char *arg;
+        uint32_t offset = strtoul(line + 4, &arg, 0);
+        uint32_t length = strtoul(arg, 0, 0);
+        xlog_sync();
+        dump_log(offset, length);
+        cmd_ok = true;
+    }
     else if (0 == strcmp(line, "play_log")) {
+        xlog_sync();
         for (uint32_t address = 0x2000; address < 0x2000 + xlog_used_space(); address += 32) {
             uint8_t buf[32];
             extflash_read(address, buf, sizeof(buf));
 
+            static const char hex[] = "0123456789ABCDEF";
+            char line_buf[3 * sizeof(buf)];
             for (int i = 0; i < sizeof(buf); i++) {
-                if (i > 0) print(" ");
-                print("%02X", buf[i]);
+                line_buf[3 * i + 0] = hex[buf[i] >> 4];
+                line_buf[3 * i + 1] = hex[buf[i] & 0x0F];
+                line_buf[3 * i + 2] = ' ';
             }
-            print('\n');
-            delay_us(1000);
+            line_buf[sizeof(line_buf) - 1] = '\n';
+            print_all((const uint8_t *)line_buf, sizeof(line_buf));
         }
     }
     if (cmd_ok) print(line);
@@ -0,0 +1,28 @@
+#include "crc.h"
+
+// Reflected polynomial 0xEDB88320, processed a nibble at a time to keep the table small
+static const uint32_t crc32_table[16] = {
+    0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac,
+    0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+    0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+    0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+};
+
+uint32_t crc32_update(uint32_t crc, const uint8_t *data, int size) {
+    crc = ~crc;
+    for (int i = 0; i < size; i++) {
+        crc = (crc >> 4) ^ crc32_table[(crc ^ (data[i] >> 0)) & 0xF];
+        crc = (crc >> 4) ^ crc32_table[(crc ^ (data[i] >> 4)) & 0xF];
+    }
+    return ~crc;
+}
+
+uint8_t crc8_update(uint8_t crc, const uint8_t *data, int size) {
+    for (int i = 0; i < size; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80) ? ((crc << 1) ^ 0x07) : (crc << 1);
+        }
+    }
+    return crc;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <stdint.h>
+
+// Standard CRC-32 (as in zlib/Ethernet). Start with crc = 0 and feed the data 
+// in any number of chunks.
+uint32_t crc32_update(uint32_t crc, const uint8_t *data, int size);
+
+// CRC-8 with polynomial 0x07 (no reflection, no final XOR), crc is the initial value
+uint8_t crc8_update(uint8_t crc, const uint8_t *data, int size);
@@ -197,6 +197,88 @@ void GPSParserBase::onFieldData (SentenceType sentence, int index, const char *v
 }
 */
 
+UBXParserBase::UBXParserBase() {
+    reset();
+}
+
+void UBXParserBase::reset() {
+    state = 0;
+    offset = 0;
+    ck_a = ck_b = 0;
+}
+
+void UBXParserBase::onFrame(uint8_t cls, uint8_t id, const uint8_t *payload, int length) {
+}
+
+void UBXParserBase::onFrameError(uint8_t cls, uint8_t id) {
+}
+
+bool UBXParserBase::decode(uint8_t c) {
+    switch (state) {
+        case 0:     // sync char 1
+            if (c != 0xB5) return false;
+            state = 1;
+            return true;
+        case 1:     // sync char 2
+            if (c != 0x62) {
+                reset();
+                return false;
+            }
+            state = 2;
+            return true;
+        case 2: cls = c; break;
+        case 3: id = c; break;
+        case 4: length = c; break;
+        case 5: 
+            length |= (c << 8); 
+            offset = 0;
+            if (length > 1024) {
+                // Corrupted header, resynchronize
+                reset();
+                return true;
+            }
+            if (length == 0) state++;   // no payload
+            break;
+        case 6:
+            if (offset < kMaxPayload) payload[offset] = c;
+            offset++;
+            if (offset < length) {
+                ck_a += c; ck_b += ck_a;
+                return true;
+            }
+            break;
+        case 7:
+            if (c != ck_a) {
+                onFrameError(cls, id);
+                reset();
+                return true;
+            }
+            state++;
+            return true;
+        case 8:
+            if (c == ck_b) {
+                onFrame(cls, id, payload, length);
+            }
+            else {
+                onFrameError(cls, id);
+            }
+            reset();
+            return true;
+    }
+    // Checksum covers class, id, length and payload
+    ck_a += c; ck_b += ck_a;
+    state++;
+    return true;
+}
+
+static inline uint16_t ubx_u2(const uint8_t *p) {
+    return p[0] | (p[1] << 8);
+}
+
+static inline int32_t ubx_i4(const uint8_t *p) {
+    return (int32_t)(p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24));
+}
+
 void GPSFix::YMDDate::parse(const char *str) {
     if (strlen(str) < 6) {
         _valid = false;
@@ -237,6 +319,13 @@ void GPSFix::HMSTime::parse(const char *str) {
     _sec = value;
 }
 
+void GPSFix::HMSTime::set(uint8_t hrs, uint8_t min, uint8_t sec, bool valid) {
+    _hrs = hrs;
+    _min = min;
+    _sec = sec;
+    _valid = valid;
+}
+
 void GPSFix::Integer::parse(const char *str) {
     int32_t value32;
     _valid = strparse(value32, str);
@@ -278,6 +367,14 @@ void GPSFix::Angle::parse(const char *str) {
     */
 }
 
+void GPSFix::Angle::set(int32_t degrees_e7, bool valid) {
+    _negative = (degrees_e7 < 0);
+    uint32_t value = _negative ? -degrees_e7 : degrees_e7;
+    _deg = value / 10000000UL;
+    _min = (value % 10000000UL) * 6.0E-6f;
+    _valid = valid;
+}
+
 void GPSFix::Latitude::parseCardinal(const char *str) {
     if (str[0] == 'N' && str[1] == '\0') {
         _negative = false;
@@ -386,6 +483,30 @@ void GPSFix::parseField(GPSParserBase::SentenceType sentence, int index, const c
     */
 }
 
+void GPSFix::parseNavPVT(const uint8_t *payload, int length) {
+    // UBX-NAV-PVT, 84 bytes (u-blox 7) or 92 bytes (u-blox 8)
+    if (length < 84) return;
+
+    uint8_t valid = payload[11];
+    uint8_t fix = payload[20];
+    uint8_t flags = payload[21];
+    bool    fix_ok = (flags & 0x01) && (fix >= 2 && fix <= 4);
+
+    time.set(payload[8], payload[9], payload[10], (valid & 0x02) != 0);
+    if (!fix_ok) fixType.set('1');
+    else fixType.set((fix == 2) ? '2' : '3');
+
+    tracked.set(payload[23]);
+    longitude.set(ubx_i4(payload + 24), fix_ok);
+    latitude.set(ubx_i4(payload + 28), fix_ok);
+    altitude.set(ubx_i4(payload + 36) * 0.001f, fix_ok && fix != 2);
+}
+
+void GPSFix::parseNavSat(const uint8_t *payload, int length) {
+    // UBX-NAV-SAT, only the header is needed
+    if (length < 8) return;
+    inView.set(payload[5]);
+}
 
 void GPSParserSimple::onChecksumError(const char *line) {
     //debug.printf("NMEA checksum ERROR\n");
@@ -399,3 +520,26 @@ void GPSParserSimple::onChecksumOK(const char *line) {
 void GPSParserSimple::onFieldData(SentenceType sentence, int index, const char *value, int length) {
     latest.parseField(sentence, index, value, length);
 }
+
+bool GPSParserSimple::decode(char c) {
+    if (UBXParserBase::decode((uint8_t)c)) return false;
+    return GPSParserBase::decode(c);
+}
+
+void GPSParserSimple::onFrame(uint8_t cls, uint8_t id, const uint8_t *payload, int length) {
+    sentences_ok++;
+    if (cls != CLASS_NAV) return;
+    switch (id) {
+        case ID_NAV_PVT: 
+            if (length <= kMaxPayload) latest.parseNavPVT(payload, length); 
+            break;
+        case ID_NAV_SAT: 
+            // Long frame, only the header has been kept
+            latest.parseNavSat(payload, length); 
+            break;
+    }
+}
+
+void GPSParserSimple::onFrameError(uint8_t cls, uint8_t id) {
+    sentences_err++;
+}
@@ -65,6 +65,40 @@ private:
 };
 
 
+class UBXParserBase {
+public:
+    UBXParserBase();
+
+    // Returns true if the byte was consumed as part of a UBX frame
+    bool decode(uint8_t c);
+
+    enum {
+        CLASS_NAV   = 0x01,
+        ID_NAV_PVT  = 0x07,
+        ID_NAV_SAT  = 0x35
+    };
+
+protected:
+    // Payload holds at most kMaxPayload bytes, length is the full frame length
+    virtual void onFrame(uint8_t cls, uint8_t id, const uint8_t *payload, int length);
+    virtual void onFrameError(uint8_t cls, uint8_t id);
+
+    enum { kMaxPayload = 100 };
+
+private:
+    void reset();
+
+    uint8_t     state;
+    uint8_t     cls;
+    uint8_t     id;
+    uint16_t    length;
+    uint16_t    offset;
+    uint8_t     ck_a;
+    uint8_t     ck_b;
+    uint8_t     payload[kMaxPayload];
+};
+
+
 struct GPSFix {
     class Field {
     public:
@@ -103,6 +137,7 @@ struct GPSFix {
         float    dayFraction()  const { return totalSeconds() / (24 * 3600.0f); }
 
         void    parse(const char *str);
+        void    set(uint8_t hrs, uint8_t min, uint8_t sec, bool valid);
 
     private:
         uint8_t     _hrs;
@@ -118,6 +153,7 @@ struct GPSFix {
         int     value() const { return _value; }
 
         void    parse(const char *str);
+        void    set(int value, bool valid = true) { _value = value; _valid = valid; }
 
     private:
         int   _value;
@@ -132,6 +168,7 @@ struct GPSFix {
         float   feet()   const { return _meters / 0.3048f; }
 
         void    parse(const char *str);
+        void    set(float meters, bool valid = true) { _meters = meters; _valid = valid; }
 
     private:
         float _meters;
@@ -157,6 +194,7 @@ struct GPSFix {
         }
 
         void     parse(const char *str);
+        void     set(int32_t degrees_e7, bool valid = true);
 
     protected:
         bool     _negative;
@@ -194,6 +232,7 @@ struct GPSFix {
         bool     atLeast2D() const { return (_fix == '3' || _fix == '2'); }
 
         void     parse(const char *str);
+        void     set(char fix) { _fix = fix; }
 
     private:
         char _fix;
@@ -209,12 +248,17 @@ struct GPSFix {
     FixType   fixType;      // Comes from GSA
 
     void parseField(GPSParserBase::SentenceType sentence, int index, const char *value, int length);
+    void parseNavPVT(const uint8_t *payload, int length);
+    void parseNavSat(const uint8_t *payload, int length);
 };
 
 
-class GPSParserSimple : public GPSParserBase {
+class GPSParserSimple : public GPSParserBase, public UBXParserBase {
 public:
-    GPSParserSimple() : GPSParserBase() { sentences_ok = sentences_err = 0; }
+    GPSParserSimple() : GPSParserBase(), UBXParserBase() { sentences_ok = sentences_err = 0; }
+
+    // Accepts both NMEA text and UBX binary input
+    bool decode(char c);
 
     const GPSFix::Latitude & latitude() const { return latest.latitude; }
     const GPSFix::Longitude & longitude() const { return latest.longitude; }
@@ -235,4 +279,6 @@ private:
     virtual void onChecksumError(const char *line);
     virtual void onChecksumOK(const char *line);
     virtual void onFieldData(SentenceType sentence, int index, const char *value, int length);
+    virtual void onFrame(uint8_t cls, uint8_t id, const uint8_t *payload, int length);
+    virtual void onFrameError(uint8_t cls, uint8_t id);
 };
@@ -0,0 +1,235 @@
+#include "journal.h"
+#include "storage.h"
+#include "settings.h"
+#include "crc.h"
+
+#include <cstring>
+
+// Journal layout
+//
+// Two sectors, only one of them is active at a time. Each sector starts with
+// a header followed by records:
+//
+//   header: 'J' 'N' generation[4] crc8 0xFF
+//   record: type size payload[size] crc32[4]
+//
+// Records are appended, the last valid record of each type wins. A record
+// never crosses a page boundary (so a save is a single page program), if it
+// doesn't fit in the rest of a page it starts at the next one and the gap
+// stays erased.
+//
+// When the active sector is full, the other one is erased, the latest record
+// of every type is copied over, followed by the new record, and only then the
+// header with the next generation number is programmed. Until that point the
+// old sector stays active, so a power loss at any time leaves a complete set.
+
+#define JOURNAL_PAGE_SIZE       256
+#define JOURNAL_HEADER_SIZE     8
+#define JOURNAL_OVERHEAD        6
+
+static int8_t   journal_active = -1;    // active sector, -1 if none is valid
+static int16_t  journal_end;            // offset of the first free byte in the active sector
+static uint32_t journal_generation;
+static bool     journal_scanned;
+
+static uint8_t  record[JOURNAL_MAX_PAYLOAD + JOURNAL_OVERHEAD];
+
+static uint32_t sector_address(int sector) {
+    return JOURNAL_START + sector * JOURNAL_SECTOR_SIZE;
+}
+
+static bool is_erased(uint32_t address) {
+    uint8_t value;
+    extflash_read(address, &value, 1);
+    return (value == 0xFF);
+}
+
+// Reads the sector header, returns true if it is valid
+static bool read_header(int sector, uint32_t &generation) {
+    uint8_t header[JOURNAL_HEADER_SIZE];
+    extflash_read(sector_address(sector), header, sizeof(header));
+    if (header[0] != 'J' || header[1] != 'N') return false;
+    if (crc8_update(0xFF, header, 6) != header[6]) return false;
+    memcpy(&generation, header + 2, 4);
+    return true;
+}
+
+// Walks the records of a sector. Finds the latest valid record of the given
+// type (if type is not 0) and returns the offset of the first free byte, or
+// JOURNAL_SECTOR_SIZE if the rest of the sector is unusable.
+static int scan_sector(int sector, uint8_t type, int &found_offset) {
+    uint32_t base = sector_address(sector);
+    int offset = JOURNAL_HEADER_SIZE;
+    found_offset = -1;
+
+    while (offset + JOURNAL_OVERHEAD <= JOURNAL_SECTOR_SIZE) {
+        uint8_t header[2];
+        extflash_read(base + offset, header, 2);
+
+        if (header[0] == 0xFF) {
+            // Either the end of the journal or the gap before a record that
+            // didn't fit in the previous page
+            int next_page = (offset + JOURNAL_PAGE_SIZE) & ~(JOURNAL_PAGE_SIZE - 1);
+            if (next_page >= JOURNAL_SECTOR_SIZE || is_erased(base + next_page)) {
+                return offset;
+            }
+            offset = next_page;
+            continue;
+        }
+
+        int length = header[1] + JOURNAL_OVERHEAD;
+        if (header[0] == 0 || header[1] > JOURNAL_MAX_PAYLOAD ||
+            (offset % JOURNAL_PAGE_SIZE) + length > JOURNAL_PAGE_SIZE)
+        {
+            // Garbage, don't append after it
+            return JOURNAL_SECTOR_SIZE;
+        }
+
+        if (header[0] == type) {
+            extflash_read(base + offset, record, length);
+            uint32_t crc;
+            memcpy(&crc, record + length - 4, 4);
+            if (crc == crc32_update(0, record, length - 4)) {
+                found_offset = offset;
+            }
+        }
+        // A record with a bad CRC (torn write) is skipped
+        offset += length;
+    }
+    return JOURNAL_SECTOR_SIZE;
+}
+
+static void journal_scan() {
+    uint32_t generation[2];
+    bool valid[2];
+    for (int sector = 0; sector < 2; sector++) {
+        valid[sector] = read_header(sector, generation[sector]);
+    }
+
+    journal_active = -1;
+    if (valid[0] && valid[1]) {
+        journal_active = ((int32_t)(generation[1] - generation[0]) > 0) ? 1 : 0;
+    }
+    else if (valid[0]) journal_active = 0;
+    else if (valid[1]) journal_active = 1;
+
+    if (journal_active >= 0) {
+        int found_offset;
+        journal_generation = generation[journal_active];
+        journal_end = scan_sector(journal_active, 0, found_offset);
+    }
+    journal_scanned = true;
+}
+
+// Returns the offset where a record of the given length can be appended
+// starting from offset, or -1 if it does not fit in the sector
+static int append_offset(int offset, int length) {
+    if ((offset % JOURNAL_PAGE_SIZE) + length > JOURNAL_PAGE_SIZE) {
+        offset = (offset + JOURNAL_PAGE_SIZE) & ~(JOURNAL_PAGE_SIZE - 1);
+    }
+    return (offset + length <= JOURNAL_SECTOR_SIZE) ? offset : -1;
+}
+
+// Builds the record in the record buffer, returns its total length
+static int make_record(uint8_t type, const void *data, int size) {
+    record[0] = type;
+    record[1] = size;
+    memcpy(record + 2, data, size);
+    uint32_t crc = crc32_update(0, record, size + 2);
+    memcpy(record + size + 2, &crc, 4);
+    return size + JOURNAL_OVERHEAD;
+}
+
+// Switches to the other sector, carrying over the latest record of every
+// type except the new one
+static int journal_compact(uint8_t type, const void *data, int size) {
+    int target = (journal_active == 0) ? 1 : 0;
+    uint32_t base = sector_address(target);
+
+    while (gState.flash.busy()) {
+        // idle wait
+    }
+    gState.flash.eraseSector(base);
+    while (gState.flash.busy()) {
+        // idle wait
+    }
+
+    int offset = JOURNAL_HEADER_SIZE;
+    if (journal_active >= 0) {
+        for (int other = 1; other <= JOURNAL_MAX_TYPE; other++) {
+            if (other == type) continue;
+            int found_offset;
+            scan_sector(journal_active, other, found_offset);
+            if (found_offset < 0) continue;
+
+            // A later (invalid) record may have overwritten the buffer
+            uint8_t length;
+            extflash_read(sector_address(journal_active) + found_offset + 1, &length, 1);
+            extflash_read(sector_address(journal_active) + found_offset, record, length + JOURNAL_OVERHEAD);
+
+            offset = append_offset(offset, length + JOURNAL_OVERHEAD);
+            if (offset < 0) return -2;
+            extflash_write(base + offset, record, length + JOURNAL_OVERHEAD);
+            offset += length + JOURNAL_OVERHEAD;
+        }
+    }
+
+    int length = make_record(type, data, size);
+    offset = append_offset(offset, length);
+    if (offset < 0) return -2;
+    extflash_write(base + offset, record, length);
+    offset += length;
+
+    // Commit the new sector
+    uint8_t header[JOURNAL_HEADER_SIZE];
+    uint32_t generation = journal_generation + 1;
+    header[0] = 'J';
+    header[1] = 'N';
+    memcpy(header + 2, &generation, 4);
+    header[6] = crc8_update(0xFF, header, 6);
+    header[7] = 0xFF;
+    extflash_write(base, header, sizeof(header));
+
+    journal_active = target;
+    journal_generation = generation;
+    journal_end = offset;
+    return 0;
+}
+
+int journal_save(uint8_t type, const void *data, int size) {
+    if (type == 0 || type > JOURNAL_MAX_TYPE) return -1;
+    if (size > JOURNAL_MAX_PAYLOAD) return -1;
+    if (!journal_scanned) journal_scan();
+
+    if (journal_active >= 0) {
+        int length = size + JOURNAL_OVERHEAD;
+        int offset = append_offset(journal_end, length);
+        if (offset >= 0) {
+            make_record(type, data, size);
+            extflash_write(sector_address(journal_active) + offset, record, length);
+            journal_end = offset + length;
+            return 0;
+        }
+    }
+    return journal_compact(type, data, size);
+}
+
+bool journal_empty() {
+    if (!journal_scanned) journal_scan();
+    return journal_active < 0;
+}
+
+int journal_load(uint8_t type, void *data, int size) {
+    if (!journal_scanned) journal_scan();
+    if (journal_active < 0) return -3;
+
+    int found_offset;
+    scan_sector(journal_active, type, found_offset);
+    if (found_offset < 0) return -1;
+
+    uint8_t length;
+    extflash_read(sector_address(journal_active) + found_offset + 1, &length, 1);
+    if (length != size) return -2;
+    extflash_read(sector_address(journal_active) + found_offset + 2, (uint8_t *)data, size);
+    return 0;
+}
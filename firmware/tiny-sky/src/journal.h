@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+
+// Append-only journal of small records (settings, calibration) in a pair of
+// sectors at the start of the external SPI flash
+#define JOURNAL_START           0x0000
+#define JOURNAL_SECTOR_SIZE     0x1000
+#define JOURNAL_MAX_PAYLOAD     128
+#define JOURNAL_MAX_TYPE        8       // record types are 1..JOURNAL_MAX_TYPE
+
+// Appends a record, the previous records of the same type become obsolete
+int journal_save(uint8_t type, const void *data, int size);
+
+// True until the first record has been written
+bool journal_empty();
+
+// Reads the latest valid record of the given type. Returns 0 on success,
+// -1 if there is none, -2 if the stored record has a different size and
+// -3 if the journal has never been written.
+int journal_load(uint8_t type, void *data, int size);
@@ -0,0 +1,77 @@
+#include "lfs_flash.h"
+#include "settings.h"
+#include "storage.h"
+
+uint32_t lfs_flash_start() {
+    return gState.flash.chipSize() - LFS_FLASH_SIZE;
+}
+
+// Block device callbacks mapping littlefs blocks to the SPI flash partition
+
+static int spi_flash_lfs_read(const struct lfs_config *c, lfs_block_t block, 
+    lfs_off_t off, void *buffer, lfs_size_t size) 
+{
+    uint32_t address = lfs_flash_start() + block * LFS_FLASH_BLOCK_SIZE + off;
+
+    extflash_read(address, (uint8_t *)buffer, size);
+    return 0;
+}
+
+static int spi_flash_lfs_prog(const struct lfs_config *c, lfs_block_t block, 
+    lfs_off_t off, const void *buffer, lfs_size_t size) 
+{
+    uint32_t address = lfs_flash_start() + block * LFS_FLASH_BLOCK_SIZE + off;
+
+    extflash_write(address, (const uint8_t *)buffer, size);
+    return 0;
+}
+
+static int spi_flash_lfs_erase(const struct lfs_config *c, lfs_block_t block) 
+{
+    uint32_t address = lfs_flash_start() + block * LFS_FLASH_BLOCK_SIZE;
+
+    while (gState.flash.busy()) {
+        // idle wait
+    }
+    gState.flash.eraseSector(address);
+    while (gState.flash.busy()) {
+        // idle wait
+    }
+    return 0;
+}
+
+static int spi_flash_lfs_sync(const struct lfs_config *c) {
+    while (gState.flash.busy()) {
+        // idle wait
+    }
+    // Nothing to sync here, indicate success
+    return 0;
+}
+
+static uint8_t lfs_read_buffer[LFS_FLASH_READ_SIZE];
+static uint8_t lfs_prog_buffer[LFS_FLASH_PROG_SIZE];
+static uint8_t lfs_file_buffer[LFS_FLASH_PROG_SIZE];
+static uint32_t lfs_lookahead_buffer[LFS_FLASH_LOOKAHEAD / 32];
+
+// Static buffers (built with LFS_NO_MALLOC), so only one file may be open at a time
+const struct lfs_config lfs_flash_cfg = {
+    .context = 0,
+
+    // block device operations
+    .read  = spi_flash_lfs_read,
+    .prog  = spi_flash_lfs_prog,
+    .erase = spi_flash_lfs_erase,
+    .sync  = spi_flash_lfs_sync,
+
+    // block device configuration
+    .read_size = LFS_FLASH_READ_SIZE,
+    .prog_size = LFS_FLASH_PROG_SIZE,
+    .block_size = LFS_FLASH_BLOCK_SIZE,
+    .block_count = LFS_FLASH_BLOCK_COUNT,
+    .lookahead = LFS_FLASH_LOOKAHEAD,
+
+    .read_buffer = lfs_read_buffer,
+    .prog_buffer = lfs_prog_buffer,
+    .lookahead_buffer = lfs_lookahead_buffer,
+    .file_buffer = lfs_file_buffer
+};
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdint.h>
+
+extern "C" {
+    #include "lfs.h"
+}
+
+// littlefs partition at the end of the external SPI flash, the flight log
+// (xlog) uses the space below it
+#define LFS_FLASH_BLOCK_SIZE    4096        // erase sector
+#define LFS_FLASH_BLOCK_COUNT   64          // 256 KB
+#define LFS_FLASH_SIZE          (LFS_FLASH_BLOCK_SIZE * LFS_FLASH_BLOCK_COUNT)
+
+#define LFS_FLASH_READ_SIZE     64
+#define LFS_FLASH_PROG_SIZE     256         // program whole pages
+#define LFS_FLASH_LOOKAHEAD     64          // multiple of 32, covers the partition
+
+extern const struct lfs_config lfs_flash_cfg;
+
+// Start address of the partition, depends on the detected flash size
+uint32_t lfs_flash_start();
@@ -37,6 +37,7 @@ void setup() {
     rcc_periph_clock_enable(RCC_MIF);
 
     systick_setup();    // enable millisecond counting
+    tickless_setup();   // calibrate LPTIM1 for tickless idle
 
     // Initialize internal peripherals
     gState.init_hw();
@@ -75,22 +76,27 @@ systime_t task_control_func(systime_t due_time) {
     return gState.task_control(due_time);
 }
 
-timer_task_t timer_tasks[7];
+systime_t task_log_func(systime_t due_time) {
+    return gState.task_log(due_time);
+}
+
+timer_task_t timer_tasks[8];
 
 int main() {
     setup();
 
-    add_task(&timer_tasks[0], task_led_func, 0, -3);
-    add_task(&timer_tasks[1], task_console_func, 0, 4);
-    add_task(&timer_tasks[2], task_gps_func, 0, 0);
-    add_task(&timer_tasks[3], task_sensors_func, 0, 3);
-    add_task(&timer_tasks[4], task_report_func, 0, -4);
-    add_task(&timer_tasks[5], task_buzz_func, 0, -3);
-    add_task(&timer_tasks[6], task_control_func, 0, 1);
+    add_task(&timer_tasks[0], task_led_func, 0, -3, "led");
+    add_task(&timer_tasks[1], task_console_func, 0, 4, "console");
+    add_task(&timer_tasks[2], task_gps_func, 0, 0, "gps");
+    add_task(&timer_tasks[3], task_sensors_func, 0, 3, "sensors");
+    add_task(&timer_tasks[4], task_report_func, 0, -4, "report");
+    add_task(&timer_tasks[5], task_buzz_func, 0, -3, "buzz");
+    add_task(&timer_tasks[6], task_control_func, 0, 1, "control");
+    add_task(&timer_tasks[7], task_log_func, 0, 2, "log");
 
     while (1) {
         schedule_tasks();
-        __asm("WFI");
+        systick_idle(gState.idle_stop_allowed());
     }
 }
 
@@ -107,42 +113,12 @@ int main() {
 // + mag calibration, EEPROM/flash save
 // + UKHAS packet forming, regular TX
 
-typedef struct {
-    uint16_t    address;    // 7/10 bit address
-    uint8_t     type;       // read/write, stop/continue
-    uint8_t     status;     // busy/complete/error
-    uint8_t     *rx_buf;
-    uint8_t     *tx_buf;
-    uint16_t    rx_len;
-    uint16_t    tx_len;
-} i2c_request_t;
-
 extern "C" {
-    // void i2c1_isr(void) {
-    //     constexpr uint32_t periph = I2C1;
-    //     uint32_t flags = I2C_ISR(periph);
-    //     if (flags & I2C_ISR_RXNE) {
-    //         // read IC2_RXDR to clear the flag
-    //         uint8_t data = I2C_RXDR(periph);
-    //     }
-    //     if (flags & I2C_ISR_TXIS) {
-    //         // write I2C_TXDR to clear the flag
-    //         uint8_t data;
-    //         I2C_TXDR(periph) = data;
-    //     }
-    //     if (flags & I2C_ISR_TC) {
-    //         // write START or STOP
-    //     }
-    //     if (flags & I2C_ISR_STOPF) {
-    //         I2C_ICR(periph) = I2C_ICR_STOPCF;
-    //     }
-    //     if (flags & I2C_ISR_NACKF) {
-    //         I2C_ICR(periph) = I2C_ICR_NACKCF;
-    //     }
-    // }
+    void i2c1_isr(void) {
+        gState.bus_i2c.onInterrupt();
+    }
     // void tim2_isr(void);
     // void tim21_isr(void);
     // void tim22_isr(void);    
     // void tim6_dac_isr(void);    // BASIC timer
-    // void lptim1_isr(void);      // Low Power timer
 }
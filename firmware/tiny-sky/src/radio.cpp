@@ -0,0 +1,354 @@
+#include "radio.h"
+#include "settings.h"
+
+#include <cstring>
+
+#include <libopencm3/cm3/cortex.h>
+#include <libopencm3/cm3/nvic.h>
+#include <libopencm3/stm32/exti.h>
+
+#include <ptlib/queue.h>
+#include <lora/airtime.h>
+#include <lora/link_rate.h>
+#include <lora/telemetry_frame.h>
+
+// DIO0 of the RFM96 is on PB10
+#define RADIO_DIO0_EXTI         EXTI10
+#define RADIO_DIO0_PORT         GPIOB
+#define RADIO_DIO0_IRQ          NVIC_EXTI4_15_IRQ
+
+// Allowance on top of the calculated time on air before giving up on TxDone
+#define RADIO_TX_MARGIN_MS      500
+
+struct RadioFrame {
+    systime_t   queued;
+    uint32_t    airtime;        // milliseconds
+    uint16_t    deadline;
+    uint8_t     length;
+    uint8_t     rate;
+    bool        listen;         // the ground station answers this frame
+    uint8_t     data[RADIO_MAX_FRAME];
+};
+
+// Frames stay in the queue until they have been sent. The consumer side is
+// either the main loop or the DIO0 interrupt, whichever set tx_busy.
+static Queue<RadioFrame, RADIO_QUEUE_LENGTH> tx_queue;
+
+static volatile bool    tx_busy;        // the frame at the queue head is being loaded or on air
+static volatile bool    tx_paused;
+static systime_t        tx_start;
+static uint32_t         tx_airtime;     // of the frame on air
+static volatile uint32_t tx_backlog;    // airtime of the queued frames, milliseconds
+
+static bool             adaptive;
+static uint8_t          tx_rate;        // of the next frame queued
+static uint8_t          tx_next_rate;   // announced by the next frame queued
+static uint8_t          modem_rate = 0xFF;  // the radio is configured for (0xFF = unknown)
+static uint8_t          unanswered;     // frames planned without a link report
+
+static volatile bool    rx_active;      // listening for a link report
+static systime_t        rx_start;
+static volatile bool    report_ready;
+static uint8_t          report_rate;    // the frame was heard at
+static int8_t           report_snr;
+
+static lora::AirtimeBudget budget(RADIO_DUTY_PERMILLE, RADIO_DUTY_WINDOW_MS);
+
+static RadioStats       stats;
+
+static void on_dio0(SPIBusRequest *req);
+
+static SPIBusRequest    irq_request = { 0, on_dio0, false, 0 };
+
+RFM96::ModemSettings radio_rate_settings(uint8_t rate) {
+    const lora::RateStep &step = lora::rate_schedule[(rate < lora::rate_count) ? rate : 0];
+    RFM96::ModemSettings ms = RFM96::ModemSettings()
+        .setSF((RFM96::sf_t)step.sf)
+        .setCR(RFM96::eCR_4_8);
+    for (int bw = RFM96::eBW_500k; bw > RFM96::eBW_7k8; bw--) {
+        ms.setBW((RFM96::bw_t)bw);
+        if (ms.bandwidthDivider() >= step.bw_div) break;
+    }
+    return ms;
+}
+
+static void backlog_add(int32_t airtime) {
+    bool masked = cm_mask_interrupts(true);
+    tx_backlog += airtime;
+    cm_mask_interrupts(masked);
+}
+
+// Removes the frame at the queue head (consumer side only)
+static void remove_head() {
+    const RadioFrame *frame;
+    tx_queue.peek_contiguous(frame);
+    backlog_add(-(int32_t)frame->airtime);
+    tx_queue.consume(1);
+}
+
+// Starts the next queued frame, unless one is on air already. Frames that
+// can't finish before their deadline anymore are skipped.
+static void start_next() {
+    bool masked = cm_mask_interrupts(true);
+    bool start = !tx_busy && !tx_paused && !tx_queue.empty();
+    if (start) {
+        tx_busy = true;
+        rx_active = false;
+    }
+    cm_mask_interrupts(masked);
+    if (!start) return;
+
+    const RadioFrame *frame;
+    while (tx_queue.peek_contiguous(frame) > 0) {
+        if (frame->deadline == 0 || millis() - frame->queued + frame->airtime <= frame->deadline) {
+            if (frame->rate != modem_rate) {
+                gState.radio.setupLoRa(radio_rate_settings(frame->rate));
+                modem_rate = frame->rate;
+            }
+            tx_airtime = frame->airtime;
+            gState.radio.writeFIFO(frame->data, frame->length);
+            tx_start = millis();
+            gState.radio.startTX();
+            return;
+        }
+        stats.frames_late++;
+        remove_head();
+    }
+    tx_busy = false;
+}
+
+static void finish_tx() {
+    systime_t airtime = millis() - tx_start;
+    stats.frames_sent++;
+    stats.airtime_total += airtime;
+    stats.airtime_last = airtime;
+    if (airtime > stats.airtime_max) stats.airtime_max = airtime;
+
+    const RadioFrame *frame;
+    tx_queue.peek_contiguous(frame);
+    bool listen = frame->listen;
+
+    remove_head();
+    tx_busy = false;
+    start_next();
+
+    // The ground station answers at the rate of the frame it heard
+    if (adaptive && listen && !tx_busy) {
+        rx_start = millis();
+        rx_active = true;
+        gState.radio.startRX();
+    }
+}
+
+// Keeps the last link report meant for us, returns false for other traffic
+static bool receive_report() {
+    uint8_t data[LINK_REPORT_LENGTH + 1];
+    uint8_t length = sizeof(data);
+    gState.radio.readFIFO(data, length);
+
+    if (length != LINK_REPORT_LENGTH || data[0] != LINK_REPORT_MAGIC) return false;
+    if (data[1] != telemetry_frame::payload_id(gSettings.radio_callsign, sizeof(gSettings.radio_callsign))) return false;
+
+    report_rate = data[4];
+    report_snr = data[5];
+    report_ready = true;
+
+    stats.reports_received++;
+    stats.report_snr = data[5];
+    stats.report_rssi = data[6];
+    stats.uplink_snr = gState.radio.getPacketSNR();
+    stats.uplink_rssi = gState.radio.getPacketRSSI();
+    return true;
+}
+
+// Runs with the bus acquired, either right from the interrupt or as soon as
+// the main loop releases the bus
+static void on_dio0(SPIBusRequest *req) {
+    if (tx_paused) return;
+
+    // A late RxDone must not take the IRQ setup of a frame just started
+    uint8_t flags = gState.radio.getIRQFlags();
+    if (tx_busy) {
+        if (flags & RFM96::eIRQ_TX_DONE) {
+            gState.radio.handleIRQ();
+            finish_tx();
+        }
+    }
+    else if (rx_active && (flags & RFM96::eIRQ_RX_DONE)) {
+        gState.radio.handleIRQ();
+        if (!(flags & RFM96::eIRQ_CRC_ERROR) && receive_report()) {
+            rx_active = false;
+            gState.radio.sleep();
+        }
+        else {
+            gState.radio.startRX();
+        }
+    }
+}
+
+void radio_begin() {
+    exti_select_source(RADIO_DIO0_EXTI, RADIO_DIO0_PORT);
+    exti_set_trigger(RADIO_DIO0_EXTI, EXTI_TRIGGER_RISING);
+    exti_enable_request(RADIO_DIO0_EXTI);
+
+    // The interrupt may load the next frame, which waits for the SPI DMA
+    // interrupt, so it must run at a lower priority
+    nvic_set_priority(RADIO_DIO0_IRQ, 0x80);
+    nvic_enable_irq(RADIO_DIO0_IRQ);
+}
+
+int radio_send(const uint8_t *data, uint8_t length, uint16_t deadline, bool listen) {
+    if (length > RADIO_MAX_FRAME) return -2;
+    if (tx_queue.full()) {
+        stats.frames_dropped++;
+        return -1;
+    }
+
+    RadioFrame frame;
+    frame.queued = millis();
+    frame.airtime = (gState.radio.timeOnAirUs(length, radio_rate_settings(tx_rate)) + 999) / 1000;
+    frame.deadline = deadline;
+    frame.length = length;
+    frame.rate = tx_rate;
+    frame.listen = listen;
+    stats.airtime_expected = frame.airtime;
+
+    if (deadline != 0 && radio_backlog_ms() + frame.airtime > deadline) {
+        stats.frames_refused++;
+        return -3;
+    }
+    budget.update(frame.queued);
+    if (!budget.consume(frame.airtime)) {
+        stats.frames_refused++;
+        return -4;
+    }
+
+    memcpy(frame.data, data, length);
+    backlog_add(frame.airtime);
+    tx_queue.push(frame);
+    tx_rate = tx_next_rate;
+
+    start_next();
+    return 0;
+}
+
+void radio_poll() {
+    bool tx_expired = tx_busy && millis() - tx_start >= tx_airtime + RADIO_TX_MARGIN_MS;
+    bool rx_expired = rx_active && millis() - rx_start >= RADIO_RX_WINDOW_MS;
+    if (!tx_expired && !rx_expired) return;
+
+    // Keep the interrupt from finishing the frame at the same time
+    nvic_disable_irq(RADIO_DIO0_IRQ);
+    if (tx_busy && !irq_request.pending && millis() - tx_start >= tx_airtime + RADIO_TX_MARGIN_MS) {
+        stats.tx_timeouts++;
+        remove_head();
+        tx_busy = false;
+        start_next();
+    }
+    if (rx_active && !irq_request.pending && millis() - rx_start >= RADIO_RX_WINDOW_MS) {
+        rx_active = false;
+        gState.radio.sleep();
+    }
+    nvic_enable_irq(RADIO_DIO0_IRQ);
+}
+
+void radio_pause() {
+    bool masked = cm_mask_interrupts(true);
+    bool abandoned = tx_busy;
+    tx_paused = true;
+    tx_busy = false;
+    rx_active = false;
+    cm_mask_interrupts(masked);
+
+    // The radio is about to be reconfigured
+    modem_rate = 0xFF;
+
+    if (abandoned) {
+        remove_head();
+        stats.frames_dropped++;
+    }
+}
+
+void radio_resume() {
+    tx_paused = false;
+    start_next();
+}
+
+void radio_set_adaptive(bool enabled) {
+    adaptive = enabled;
+}
+
+uint8_t radio_rate() {
+    return tx_rate;
+}
+
+uint8_t radio_plan_rate() {
+    bool masked = cm_mask_interrupts(true);
+    bool reported = report_ready;
+    uint8_t heard_rate = report_rate;
+    int8_t snr = report_snr;
+    report_ready = false;
+    cm_mask_interrupts(masked);
+
+    if (!adaptive) {
+        tx_next_rate = 0;
+    }
+    else if (reported) {
+        unanswered = 0;
+        tx_next_rate = lora::next_rate(tx_rate, heard_rate, snr);
+    }
+    else if (++unanswered >= LINK_REPORT_TIMEOUT) {
+        // The ground station has most likely lost us and fallen back too
+        tx_next_rate = 0;
+    }
+    else {
+        tx_next_rate = tx_rate;
+    }
+    return tx_next_rate;
+}
+
+bool radio_busy() {
+    return tx_busy;
+}
+
+int radio_queued() {
+    return tx_queue.size();
+}
+
+uint32_t radio_backlog_ms() {
+    bool masked = cm_mask_interrupts(true);
+    uint32_t backlog = tx_backlog;
+    if (tx_busy) {
+        // Only the rest of the frame on air
+        uint32_t elapsed = millis() - tx_start;
+        backlog -= (elapsed < tx_airtime) ? elapsed : tx_airtime;
+    }
+    cm_mask_interrupts(masked);
+    return backlog;
+}
+
+uint32_t radio_budget_ms() {
+    budget.update(millis());
+    return budget.available();
+}
+
+const RadioStats & radio_stats() {
+    return stats;
+}
+
+void radio_stats_reset() {
+    bool masked = cm_mask_interrupts(true);
+    memset(&stats, 0, sizeof(stats));
+    cm_mask_interrupts(masked);
+}
+
+extern "C" {
+    void exti4_15_isr(void) {
+        if (!exti_get_flag_status(RADIO_DIO0_EXTI)) return;
+        exti_reset_request(RADIO_DIO0_EXTI);
+
+        if (!irq_request.pending) {
+            RFM96_HAL::submit(&irq_request);
+        }
+    }
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "rfm96.h"
+
+// Outgoing frame queue of the LoRa radio. Frames are sent back-to-back, the
+// next one is started from the DIO0 (TxDone) interrupt of the previous one.
+#define RADIO_MAX_FRAME         64      // payload bytes
+#define RADIO_QUEUE_LENGTH      4       // must be a power of two
+
+// Duty cycle limit, averaged over a window. Telemetry alone (SF10, CR 4/8,
+// ~1.1 s every 5 s) takes about 22%.
+#define RADIO_DUTY_PERMILLE     250
+#define RADIO_DUTY_WINDOW_MS    60000
+
+// In adaptive mode the receiver listens for a link report from the ground
+// station after the last queued frame (~11 mA while it lasts)
+#define RADIO_RX_WINDOW_MS      1500
+
+struct RadioStats {
+    uint32_t    frames_sent;
+    uint32_t    frames_dropped;     // queue full, or abandoned by radio_pause()
+    uint32_t    frames_refused;     // would overrun their deadline or the duty cycle budget
+    uint32_t    frames_late;        // couldn't finish before their deadline anymore, skipped
+    uint32_t    tx_timeouts;        // TxDone never came
+    uint32_t    airtime_total;      // milliseconds
+    uint16_t    airtime_last;       // milliseconds
+    uint16_t    airtime_max;        // milliseconds
+    uint16_t    airtime_expected;   // calculated for the last frame, milliseconds
+    uint32_t    reports_received;   // link reports from the ground station
+    int8_t      report_snr;         // of the last frame heard by the ground, dB
+    int8_t      report_rssi;        // of the last frame heard by the ground, dBm
+    int8_t      uplink_snr;         // of the last link report, dB
+    int8_t      uplink_rssi;        // of the last link report, dBm
+};
+
+// Sets up the DIO0 interrupt, the radio must be configured for LoRa already
+void radio_begin();
+
+// Queues a frame that must be sent within deadline milliseconds (0 = no
+// deadline), at radio_rate(). Frames that can't make it behind the ones
+// already queued, or don't fit in the duty cycle budget, are refused.
+// Returns 0 on success, -1 if the queue is full, -2 if the frame is too
+// long, -3 if it would miss the deadline and -4 if it would exceed the
+// duty cycle. With listen (and adaptive mode), a link report is expected
+// after the frame.
+int radio_send(const uint8_t *data, uint8_t length, uint16_t deadline = 0, bool listen = false);
+
+// Recovers from a missed TxDone, call periodically
+void radio_poll();
+
+// Stops the queue (e.g. before reconfiguring the radio for another modem),
+// the frame on air is abandoned. Queued frames are kept for radio_resume().
+void radio_pause();
+void radio_resume();
+
+// Adaptive data rate (see lora/link_rate.h). Frames are sent at
+// radio_rate(), radio_plan_rate() picks the rate that takes over after the
+// next frame, which must announce it. Disabled, everything goes out at the
+// default rate 0.
+void radio_set_adaptive(bool enabled);
+uint8_t radio_rate();
+uint8_t radio_plan_rate();
+
+// LoRa modem settings for a rate index
+RFM96::ModemSettings radio_rate_settings(uint8_t rate);
+
+bool radio_busy();
+int radio_queued();
+uint32_t radio_backlog_ms();        // airtime of the frames not sent yet
+uint32_t radio_budget_ms();         // airtime left in the duty cycle budget
+const RadioStats & radio_stats();
+void radio_stats_reset();
@@ -1,71 +1,86 @@
 #include "rfm96.h"
+#include "sx1276_impl.h"
 
 #include "systick.h"
 
 #include <ptlib/ptlib.h>
 
 typedef SPI<SPI1, PB_5, PB_4, PB_3> SPI_;
+typedef SPIBus<SPI_> Bus;
+
+// Upper limits: the SX1276 is specified up to 10 MHz, the flash takes the
+// maximum SPI clock. With the 16 MHz APB clock both get PCLK/2 = 8 MHz, the
+// limits only tell apart at a faster system clock.
+static const SPIDeviceConfig kRadioDevice = { 10000000, 0 };
+static const SPIDeviceConfig kFlashDevice = { 16000000, 0 };
 
 typedef DigitalOut<PA_9>  RFM96_RST;
 typedef DigitalOut<PA_10> RFM96_NSS;
 
 typedef DigitalOut<PA_15> Flash_NSS;
 
+// The driver is instantiated here only, with the register definitions 
+// kept out of the other translation units
+template class SX1276<RFM96_HAL>;
+
 void RFM96::init() {
-    SX1276_Base::init();
-    SX1276_Base::setPABoost(true);
+    SX1276::init();
+    SX1276::setPABoost(true);
 }
 
-uint8_t RFM96::hal_spi_transfer (uint8_t outval) {
-    uint8_t value = SPI_::write(outval);
-    //while (SPI::is_busy()) {}
-    return value;
+void RFM96_HAL::select() {
+    Bus::acquire(kRadioDevice);
+    RFM96_NSS::write(0);
 }
 
-void RFM96::hal_pin_nss (uint8_t val) {
-    //hal_delay_us(1000);
-    RFM96_NSS::write(val);
-    //hal_delay_us(1000);
+void RFM96_HAL::release() {
+    RFM96_NSS::write(1);
+    Bus::release();
 }
 
-void RFM96::hal_pin_rxtx (uint8_t val) {
+uint8_t RFM96_HAL::transfer (uint8_t outval) {
+    return SPI_::write(outval);
 }
 
-void RFM96::hal_pin_rst (uint8_t val) {
-    RFM96_RST::write(val);
+void RFM96_HAL::transfer (const uint8_t *tx, uint8_t *rx, int len) {
+    SPI_::transfer(tx, rx, len);
 }
 
-void RFM96::hal_disableIRQs (void) {
-
+void RFM96_HAL::pin_rxtx (uint8_t val) {
 }
 
-void RFM96::hal_enableIRQs (void) {
+void RFM96_HAL::pin_rst (uint8_t val) {
+    RFM96_RST::write(val);
+}
 
+void RFM96_HAL::delay_us (uint32_t us) {
+    ::delay_us(us);
 }
 
-void RFM96::hal_delay_us (uint32_t us) {
-    delay_us(us);    
+void RFM96_HAL::submit (SPIBusRequest *req) {
+    req->device = &kRadioDevice;
+    Bus::submit(req);
 }
 
 
 
 void SPIFlash::select() {
+    Bus::acquire(kFlashDevice);
     Flash_NSS::write(0);
 }
 
 void SPIFlash::release() {
     Flash_NSS::write(1);
+    Bus::release();
 }
 
 void SPIFlash::transfer(const uint8_t *wr_buf, int wr_len, uint8_t *rd_buf, int rd_len) {
-    while (wr_len > 0) {
-        SPI_::write(*wr_buf);
-        wr_buf++;
-        wr_len--;
-    }
-    while (rd_len > 0) {
-        *rd_buf = SPI_::write(0);
-        rd_buf++;
-        rd_len--;
+    if (wr_len > 0) SPI_::transfer(wr_buf, 0, wr_len);
+    if (rd_len > 0) SPI_::transfer(0, rd_buf, rd_len);
+}
+
+extern "C" {
+    void dma1_channel2_3_isr(void) {
+        SPI_::onDMAComplete();
     }
 }
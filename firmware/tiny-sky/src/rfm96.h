@@ -3,22 +3,29 @@
 #include "sx1276.h"
 #include "flash.h"
 
-class RFM96 : public SX1276_Base {
-public:
-    void init();
+#include <ptlib/spibus.h>
 
-private:
-    virtual uint8_t hal_spi_transfer (uint8_t outval) override;
-    virtual void hal_pin_nss (uint8_t val) override;
-    virtual void hal_pin_rst (uint8_t val) override;
-    virtual void hal_pin_rxtx (uint8_t val) override;
-    virtual void hal_disableIRQs (void) override;
-    virtual void hal_enableIRQs (void) override;
+// Static HAL for the RFM96 module on SPI1 (see sx1276.h)
+struct RFM96_HAL {
+    static void select();
+    static void release();
+    static uint8_t transfer(uint8_t outval);
+    static void transfer(const uint8_t *tx, uint8_t *rx, int len);
+    static void pin_rst(uint8_t val);
+    static void pin_rxtx(uint8_t val);
+    static void delay_us(uint32_t us);
+
+    // Runs the request with the bus acquired for the radio, e.g. to service
+    // a radio interrupt (see SPIBus::submit)
+    static void submit(SPIBusRequest *req);
+};
 
-    //virtual uint32_t hal_ticks (void) override;
-    //virtual void hal_waitUntil (uint32_t time) override;
-    //virtual uint32_t hal_ms2ticks(uint32_t ms) override;
-    virtual void hal_delay_us(uint32_t us) override;
+// Instantiated in rfm96.cpp
+extern template class SX1276<RFM96_HAL>;
+
+class RFM96 : public SX1276<RFM96_HAL> {
+public:
+    void init();
 };
 
 class SPIFlash : public SPIFlash_Base {
@@ -17,11 +17,15 @@
 extern "C" {
     void usart1_isr() {
         uint32_t flags = USART_ISR(USART1);
-        if (flags & USART_ISR_RXNE) {
-            SerialGPS::onReceived();
+        if (flags & (USART_ISR_IDLE | USART_ISR_ORE | USART_ISR_FE | USART_ISR_NF | USART_ISR_WUF)) {
+            SerialGPS::onReceiveEvent();
         }
-        if (flags & USART_ISR_TXE) {
+        if ((flags & USART_ISR_TXE) && (USART_CR1(USART1) & USART_CR1_TXEIE)) {
             SerialGPS::onTransmitEmpty();
         }
     }
+
+    void dma1_channel4_7_isr() {
+        SerialGPS::onDMAEvent();
+    }
 }
\ No newline at end of file
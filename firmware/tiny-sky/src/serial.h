@@ -47,7 +47,131 @@ Queue<uint8_t,  rx_queue_size> BufferedSerial<Base, rx_queue_size, tx_queue_size
 template<typename Base, int rx_queue_size, int tx_queue_size>
 Queue<uint8_t,  tx_queue_size> BufferedSerial<Base, rx_queue_size, tx_queue_size>::txQueue;
 
-typedef BufferedSerial<USART<USART1, PB_6, PB_7>, 128, 64> SerialGPS;
+#include <libopencm3/cm3/cortex.h>
+
+// Same interface as BufferedSerial, but bytes are received by DMA into a 
+// circular buffer, so there is no interrupt per received byte. 
+// rx_buffer_size must be a power of two.
+template<typename Base, int rx_buffer_size = 256, int tx_queue_size = 32>
+class DMASerial : public Base {
+public:
+    static void begin(int baudrate = 9600) {
+        rxTail = rxHeadCache = 0;
+        rxWraps = 0;
+        rxOverruns = 0;
+        Base::begin(baudrate);
+        Base::enableIRQ();
+        Base::beginRXDMA(rxBuffer, rx_buffer_size);
+    }
+
+    // Called from the USART interrupt on IDLE, error and wakeup events
+    static void onReceiveEvent() {
+        if (Base::clearRXEvents()) {
+            rxOverruns++;
+        }
+        rxIdle = true;
+    }
+
+    // Called from the DMA channel interrupt
+    static void onDMAEvent() {
+        const uint8_t ch = Base::dma_rx_channel;
+        if (dma_get_interrupt_flag(DMA1, ch, DMA_TCIF)) {
+            dma_clear_interrupt_flags(DMA1, ch, DMA_TCIF | DMA_GIF);
+            rxWraps++;
+        }
+    }
+
+    static void onTransmitEmpty() {
+        uint8_t ch;
+        if (txQueue.pop(ch)) {
+            Base::send(ch);
+        }
+        else {
+            Base::disableTXInterrupt();
+        }
+    }
+
+    static bool putc(uint8_t c) {
+        if (txQueue.push(c)) {
+            Base::enableTXInterrupt();
+            return true;
+        }
+        return false;
+    }
+
+    static bool getc(uint8_t &c) {
+        if (rxTail == rxHeadCache) {
+            rxHeadCache = rxHead();
+            if (rxHeadCache - rxTail > rx_buffer_size) {
+                // DMA has lapped the reader, skip the overwritten data
+                rxOverruns++;
+                rxTail = rxHeadCache - rx_buffer_size;
+            }
+            if (rxTail == rxHeadCache) return false;
+        }
+        c = rxBuffer[rxTail & (rx_buffer_size - 1)];
+        rxTail++;
+        return true;
+    }
+
+    // True if the line went idle (end of a burst) since the last call
+    static bool idle() {
+        bool result = rxIdle;
+        rxIdle = false;
+        return result;
+    }
+
+    static uint32_t overruns() {
+        return rxOverruns;
+    }
+
+    static Queue<uint8_t, tx_queue_size> txQueue;
+
+private:
+    // Total number of bytes received so far (modulo 2^32)
+    static uint32_t rxHead() {
+        bool masked = cm_mask_interrupts(true);
+        uint32_t remaining = Base::rxDMARemaining();
+        uint32_t wraps = rxWraps;
+        if (dma_get_interrupt_flag(DMA1, Base::dma_rx_channel, DMA_TCIF) && remaining > rx_buffer_size / 2) {
+            // Wrapped around, but the interrupt has not been serviced yet
+            wraps++;
+        }
+        cm_mask_interrupts(masked);
+        return wraps * rx_buffer_size + (rx_buffer_size - remaining);
+    }
+
+    static volatile uint8_t     rxBuffer[rx_buffer_size];
+    static volatile uint32_t    rxWraps;
+    static volatile uint32_t    rxOverruns;
+    static volatile bool        rxIdle;
+    static uint32_t             rxTail;
+    static uint32_t             rxHeadCache;
+};
+
+template<typename Base, int rx_buffer_size, int tx_queue_size>
+volatile uint8_t DMASerial<Base, rx_buffer_size, tx_queue_size>::rxBuffer[rx_buffer_size];
+
+template<typename Base, int rx_buffer_size, int tx_queue_size>
+volatile uint32_t DMASerial<Base, rx_buffer_size, tx_queue_size>::rxWraps;
+
+template<typename Base, int rx_buffer_size, int tx_queue_size>
+volatile uint32_t DMASerial<Base, rx_buffer_size, tx_queue_size>::rxOverruns;
+
+template<typename Base, int rx_buffer_size, int tx_queue_size>
+volatile bool DMASerial<Base, rx_buffer_size, tx_queue_size>::rxIdle;
+
+template<typename Base, int rx_buffer_size, int tx_queue_size>
+uint32_t DMASerial<Base, rx_buffer_size, tx_queue_size>::rxTail;
+
+template<typename Base, int rx_buffer_size, int tx_queue_size>
+uint32_t DMASerial<Base, rx_buffer_size, tx_queue_size>::rxHeadCache;
+
+template<typename Base, int rx_buffer_size, int tx_queue_size>
+Queue<uint8_t,  tx_queue_size> DMASerial<Base, rx_buffer_size, tx_queue_size>::txQueue;
+
+//typedef BufferedSerial<USART<USART1, PB_6, PB_7>, 128, 64> SerialGPS;
+typedef DMASerial<USART<USART1, PB_6, PB_7>, 256, 64> SerialGPS;
 // USART<USART1, PB_6, PB_7> usart_gps;
 
 struct OutRawStreamBase {
@@ -2,11 +2,17 @@
 
 #include <libopencm3/stm32/adc.h>
 
+#include <lora/link_rate.h>
+
 #include <cstring>
+#include <cstddef>
 
 #include "systick.h"
 #include "console.h"
 #include "storage.h"
+#include "lfs_flash.h"
+#include "journal.h"
+#include "radio.h"
 
 extern "C" {
 #include "cdcacm.h"
@@ -41,6 +47,7 @@ AppSettings::AppSettings() :
         { "radio_tx_power",  PARAM_INT, -1, &radio_tx_power },
         { "radio_tx_period", PARAM_INT, 2, &radio_tx_period },
         { "radio_tx_start",  PARAM_INT, 2, &radio_tx_start },
+        { "radio_adaptive",  PARAM_INT, 1, &radio_adaptive },
 
         { "pyro_safe_time",  PARAM_INT, 2, &pyro_safe_time },
         //{ "pyro_safe_altitude",  PARAM_INT, 2, &pyro_safe_altitude },
@@ -65,6 +72,7 @@ void AppSettings::reset() {
     radio_callsign[3]   = '\0';
     radio_tx_period     = 5;
     radio_tx_start      = 0;
+    radio_adaptive      = 0;
     radio_frequency     = 434.25f * 1000000;
     radio_cw_frequency  = 444.25f * 1000000;
     radio_tx_power      = 13;   // TODO: change
@@ -87,101 +95,75 @@ void AppCalibration::reset() {
 }
 
 
-int AppSettings::save() {
-    // address must point to EEPROM space (begins at 0x0808 0000)
-    // void eeprom_program_word(uint32_t address, uint32_t data);
-    // void eeprom_program_words(uint32_t address, uint32_t *data, int length_in_words);
+// Settings and calibration are records in the flash journal (journal.cpp).
+// Boards that still have the old layout (raw structs in the first two flash
+// sectors, where the journal goes) keep reading it until the first save,
+// which carries both structs over into the journal.
+#define JOURNAL_SETTINGS        1
+#define JOURNAL_CALIBRATION     2
 
-    // uint32_t addr_eeprom = 0x08080000 + 0;
-    // const uint32_t n_words = (3 + sizeof(AppSettings)) / 4;
+#define LEGACY_SETTINGS_ADDR    0x0000
+#define LEGACY_CALIBRATION_ADDR 0x1000
 
-    // eeprom_write(addr_eeprom, (uint32_t *)(this), n_words);
-    
-    must_be_zero = 0;
-    while (gState.flash.busy()) {
-        // idle wait
-    }
-    gState.flash.eraseSector(0x0000);
-    while (gState.flash.busy()) {
-        // idle wait
-    }
-    extflash_write(0x0000, (const uint8_t *)this, sizeof(AppSettings));
+// Only the values are stored, not the parameter descriptors
+#define SETTINGS_DATA_OFFSET    offsetof(AppSettings, radio_callsign)
+#define SETTINGS_DATA_SIZE      (sizeof(AppSettings) - SETTINGS_DATA_OFFSET)
 
-    // lfs_file_t  file;
-    // int         err;
+// The legacy raw struct had 8 parameter descriptors in front of the values
+#define LEGACY_SETTINGS_OFFSET  (8 * sizeof(AppSettings::param_descriptor_t))
 
-    // // Attempt to open settings file
-    // // TODO: do we need the LFS_O_TRUNC?
-    // err = lfs_file_open(&gState.lfs, &file, "settings", LFS_O_WRONLY | LFS_O_TRUNC | LFS_O_CREAT);
-    // if (err) {
-    //     return -1;
-    // }
+// Copies the legacy structs into the journal before its first write erases
+// them. Only valid ones are copied, the same check as in restore().
+static int journal_migrate() {
+    if (!journal_empty()) return 0;
 
-    // err = lfs_file_write(&gState.lfs, &file, (const void *)this, sizeof(AppSettings));
-    // lfs_file_close(&gState.lfs, &file);
+    uint8_t settings_data[SETTINGS_DATA_SIZE];
+    AppCalibration calibration;
+    extflash_read(LEGACY_SETTINGS_ADDR + LEGACY_SETTINGS_OFFSET, settings_data, SETTINGS_DATA_SIZE);
+    extflash_read(LEGACY_CALIBRATION_ADDR, (uint8_t *)&calibration, sizeof(AppCalibration));
 
-    // // // TODO: check err and do something about it (retry?)
-    // if (err < 0) return -2;
-    return 0;
+    int err = 0;
+    if (settings_data[offsetof(AppSettings, must_be_zero) - SETTINGS_DATA_OFFSET] == 0) {
+        err = journal_save(JOURNAL_SETTINGS, settings_data, SETTINGS_DATA_SIZE);
+    }
+    if (!err && calibration.must_be_zero == 0) {
+        err = journal_save(JOURNAL_CALIBRATION, &calibration, sizeof(AppCalibration));
+    }
+    return err;
+}
+
+int AppSettings::save() {
+    if (journal_migrate()) return -1;
+    must_be_zero = 0;
+    return journal_save(JOURNAL_SETTINGS, (const uint8_t *)this + SETTINGS_DATA_OFFSET, SETTINGS_DATA_SIZE);
 }
 
 int AppSettings::restore() {
-    extflash_read(0x0000, (uint8_t *)this, sizeof(AppSettings));
-    if (must_be_zero != 0) {
+    uint8_t *data = (uint8_t *)this + SETTINGS_DATA_OFFSET;
+    int err = journal_load(JOURNAL_SETTINGS, data, SETTINGS_DATA_SIZE);
+    if (err == -3) {
+        extflash_read(LEGACY_SETTINGS_ADDR + LEGACY_SETTINGS_OFFSET, data, SETTINGS_DATA_SIZE);
+        err = (must_be_zero == 0) ? 0 : -1;
+    }
+    if (err) {
         reset();
     }
-
-    // lfs_file_t  file;
-    // int         err;
-
-    // // Attempt to open settings file
-    // err = lfs_file_open(&gState.lfs, &file, "settings", LFS_O_RDONLY);  // LFS_O_CREAT
-    // if (err) {
-    //     reset();
-    //     // File not open, so just return
-    //     return -1;
-    // }
-
-    // err = lfs_file_read(&gState.lfs, &file, (void *)this, sizeof(AppSettings));
-    // lfs_file_close(&gState.lfs, &file);
-
-    // if (err < 0) {
-    //     // Reading failed 
-    //     reset();
-    //     return -2;
-    // }
-
-    // // if (err < sizeof(AppSettings))   // or we read too few bytes
-
     return 0;
-
-    // // address must point to EEPROM space (begins at 0x0808 0000)
-    // // void eeprom_program_word(uint32_t address, uint32_t data);
-    // // void eeprom_program_words(uint32_t address, uint32_t *data, int length_in_words);
-
-    // //eeprom_program_words(0x08080000 + 0, (uint32_t *)(this), (3 + sizeof(AppSettings)) / 4);
-    // uint32_t addr_eeprom = 0x08080000 + 0;
-    // const uint32_t n_bytes = sizeof(AppSettings);
-
-    // memcpy((void *)(this), (const void *)addr_eeprom, n_bytes);
 }
 
 int AppCalibration::save() {
+    if (journal_migrate()) return -1;
     must_be_zero = 0;
-    while (gState.flash.busy()) {
-        // idle wait
-    }
-    gState.flash.eraseSector(0x1000);
-    while (gState.flash.busy()) {
-        // idle wait
-    }
-    extflash_write(0x1000, (const uint8_t *)this, sizeof(AppCalibration));
-    return 0;
+    return journal_save(JOURNAL_CALIBRATION, this, sizeof(AppCalibration));
 }
 
 int AppCalibration::restore() {
-    extflash_read(0x1000, (uint8_t *)this, sizeof(AppCalibration));
-    if (must_be_zero != 0) {
+    int err = journal_load(JOURNAL_CALIBRATION, this, sizeof(AppCalibration));
+    if (err == -3) {
+        extflash_read(LEGACY_CALIBRATION_ADDR, (uint8_t *)this, sizeof(AppCalibration));
+        err = (must_be_zero == 0) ? 0 : -1;
+    }
+    if (err) {
         reset();
     }
     return 0;
@@ -191,7 +173,21 @@ int AppState::init_lfs() {
     if (!flash.initialize()) return -1;
     delay(10);
 
-    return xlog_init();
+    int err = xlog_init();
+    if (err) return err;
+
+    // Mount the filesystem partition, format it if we can't mount it
+    // (this should only happen on the first boot)
+    systime_t start = millis();
+    int lfs_err = lfs_mount(&lfs, &lfs_flash_cfg);
+    if (lfs_err) {
+        lfs_format(&lfs, &lfs_flash_cfg);
+        lfs_err = lfs_mount(&lfs, &lfs_flash_cfg);
+    }
+    lfs_mount_ms = millis() - start;
+    lfs_ok = (lfs_err == 0);
+
+    return 0;
 }
 
 int AppState::init_hw() {
@@ -201,20 +197,28 @@ int AppState::init_hw() {
 
     adc.begin();
     adc.enableVREFINT();
-    adc.setConversionMode(adc.eDISCONTINUOUS);
+    adc.setOversampling(adc.eOVS_16X, 4);   // average 16 samples, 12 bit result
+    adc.setConversionMode(adc.eSINGLE);
     adc.setSampleTime(7);
+    adc.clearSequence();
+    adc.addChannel(ADC_CHANNEL_VREF);
+    adc.addChannel(adc_v_batt.channel);
+    adc.addChannel(adc_v_pyro.channel);
+    adc.addChannel(adc_pyro_sense1.channel);
+    adc.beginDMA(adc_results, 4);
 
     usart_gps.begin();
+    usart_gps.enableWakeupFromStop();
 
     bus_i2c.begin();
-    //bus_i2c.enableIRQ();
-    //bus_i2c.enableSTOPInterrupt();
-    //bus_i2c.enableNACKInterrupt();
+    bus_i2c.enableIRQ();
 
     bus_spi.begin();
     bus_spi.format(8, 0);
     bus_spi.frequency(16000000);
+    bus_spi.beginDMA();
 
+    loraDIO0.begin();
     loraDIO2.begin();
     loraRST.begin(1);
     loraSS.begin(1);
@@ -233,6 +237,9 @@ int AppState::init_hw() {
     adc_pyro_sense1.begin();
     adc_pyro_sense2.begin();
 
+    // First scan, so that task_sensors has readings on its first run
+    adc.startScan();
+
     return 0;    
 }
 
@@ -255,10 +262,7 @@ int AppState::init_periph() {
     ublox_cfg_tp5(5, 1, 1 << 31, 1 << 29, true, false);
 
     radio.init();
-    radio.setupLoRa(RFM96::ModemSettings()
-        .setSF(RFM96::eSF_10)
-        .setCR(RFM96::eCR_4_8)
-    );
+    radio.setupLoRa(radio_rate_settings(0));
     // radio.setupLoRa(RFM96::ModemSettings()
     //     .setSF(RFM96::eSF_9)
     //     .setBW(RFM96::eBW_31k25)
@@ -266,6 +270,8 @@ int AppState::init_periph() {
     // );
     radio.setFrequencyHz(gSettings.radio_frequency);
     radio.setTXPower(gSettings.radio_tx_power);
+    radio_begin();
+    radio_set_adaptive(gSettings.radio_adaptive);
 
     // Initialize magnetic field sensor
     if (mag.initialize()) {
@@ -292,6 +298,9 @@ int AppState::init_periph() {
         // Less than 10 ms sampling time
         gyro.setupGyro(LSM6DS33::eODR_G_104Hz, LSM6DS33::eFS_G_2000DPS); // 0.070 dps/LSB // TODO: change FS
         gyro.setupAccel(LSM6DS33::eODR_XL_104Hz, LSM6DS33::eFS_XL_16G); // 0.488 mg/LSB
+        // The FIFO stays off until task_sensors starts logging
+        gyro.setupFIFO(LSM6DS33::eFIFO_BYPASS, LSM6DS33::eODR_G_104Hz, 2 * XLOG_IMU_MAX_SAMPLES);
+        gyro_fifo_dec = 0;
         gyro_initialized = true;
         gyro.trigger();
         last_time_gyro = millis();
@@ -308,6 +317,12 @@ int AppState::init_periph() {
     statusLED = buzzerOn = 0;
 }
 
+bool AppState::idle_stop_allowed() {
+    // USB needs HSI48 running, so only enter STOP mode when not connected
+    // An ADC scan in progress would be stopped along with HSI16
+    return !usb_cdc_connected() && !adc.isBusy();
+}
+
 void AppState::buzz_times(int times) {
     for (int i = 0; i < times; i++) {
         gState.buzzerOn = 1;
@@ -317,6 +332,16 @@ void AppState::buzz_times(int times) {
     }
 }
 
+// Switches the receiver to binary NAV-PVT/NAV-SAT output at 5 Hz. At 9600
+// baud (960 B/s) NAV-PVT takes 500 B/s, NAV-SAT (16 + 12 bytes per
+// satellite) only goes out every 5 s to keep the link around 60% busy.
+void AppState::gps_setup_ubx() {
+    ublox_cfg_ubx_only(9600);
+    ublox_enable_msg(0x01, 0x07, 1);    // NAV-PVT every epoch
+    ublox_enable_msg(0x01, 0x35, 25);   // NAV-SAT every 5 seconds
+    ublox_set_rate(200);
+}
+
 systime_t AppState::task_gps(systime_t due_time) {
     uint8_t ch;
     while (usart_gps.getc(ch)) {
@@ -336,6 +361,7 @@ systime_t AppState::task_gps(systime_t due_time) {
     if (!platform_updated && millis() > 5000) {
         // Set GNSS platform type (e.g. airborne 1g)
         ublox_set_dyn_mode((ublox_dyn_t)gSettings.ublox_platform_type);
+        gps_setup_ubx();
 
         platform_updated = true;
     }
@@ -407,8 +433,13 @@ systime_t AppState::task_report(systime_t due_time) {
 
     bool is_armed = (state != eSAFE);
 
+    radio_poll();
+
+    // Reports come faster when the link allows a faster rate
+    uint8_t interval = lora::rate_schedule[radio_rate()].interval_s;
+
     counter++;
-    if (counter == 5) {
+    if (counter >= interval) {
         counter = 0;
     }
     
@@ -444,10 +475,24 @@ systime_t AppState::task_report(systime_t due_time) {
         telemetry.minute = gps.fixTime().minute();
         telemetry.second = gps.fixTime().second();
 
-        if (telemetry.build_string((char *)packet_data, packet_length)) {
+        telemetry.pyro_state = is_pyro1_on ? 1 : 0;
+        telemetry.flight_state = state;
+
+        bool built;
+        bool binary = (telemetry.msg_id % TELEMETRY_ASCII_INTERVAL != 0);
+        if (!binary) {
+            built = telemetry.build_string((char *)packet_data, packet_length);
+        }
+        else {
+            // Only binary frames announce rate changes
+            telemetry.next_rate = radio_plan_rate();
+            built = telemetry.build_binary(packet_data, packet_length);
+        }
+        if (built) {
             if (state != eFLIGHT) {
-                radio.writeFIFO(packet_data, packet_length);
-                radio.startTX();
+                // Stale after the next report is due. The ground station
+                // only answers binary frames.
+                radio_send(packet_data, packet_length, interval * 1000, binary);
             }
         }
     }
@@ -534,44 +579,47 @@ ARM mode:
     }
 }
 
+// Full rate IMU logging continues this long after the ejection (ms)
+#define IMU_FULL_RATE_AFTER_EJECT   30000UL
+
 systime_t AppState::task_sensors(systime_t due_time) {
     static int      cal_mx_min, cal_mx_max;
     static int      cal_count;
 
     bool is_armed = (state != eSAFE);
 
-    adc.setChannel(ADC_CHANNEL_VREF);
-    adc.startConversion();
-    while (!adc.isEOC());
-    uint16_t v_dd = adc.read();
-    last_vdd = 1220 * (1 << 12) / v_dd; // VREFINT = 1224 mV
-    //last_vdd = (3000 * ST_VREFINT_CAL) / v_dd;
-
-    adc.setChannel(adc_v_batt.channel);
-    adc.startConversion();
-    while (!adc.isEOC());
-    uint16_t v_batt = adc.read();
-    last_v_batt = (v_batt * 2 * last_vdd) / (1 << 12);
-
-    adc.setChannel(adc_v_pyro.channel);
-    adc.startConversion();
-    while (!adc.isEOC());
-    uint16_t v_pyro = adc.read();
-    last_v_pyro = (v_pyro * 2 * last_vdd) / (1 << 12);
-
-    adc.setChannel(adc_pyro_sense1.channel);
-    adc.startConversion();
-    while (!adc.isEOC());
-    uint16_t v_sense1 = adc.read();
-    last_pyro_sense1 = (v_sense1 * 2 * last_vdd) / (1 << 12);
+    // Queue the sensor reads first, they proceed in the background 
+    // while the ADC results are processed
+    bus_i2c.poll();
+    if (baro_initialized) baro.startRead(req_baro);
+    if (mag_initialized) mag.startRead(req_mag);
+    if (gyro_initialized) gyro.startRead(req_gyro);
+
+    // Convert the results of the scan started in the previous run
+    if (adc.isScanComplete()) {
+        uint16_t v_dd = adc_results[adc.sequenceIndex(ADC_CHANNEL_VREF)];
+        last_vdd = 1220 * (1 << 12) / v_dd; // VREFINT = 1224 mV
+        //last_vdd = (3000 * ST_VREFINT_CAL) / v_dd;
+
+        uint16_t v_batt = adc_results[adc.sequenceIndex(adc_v_batt.channel)];
+        last_v_batt = (v_batt * 2 * last_vdd) / (1 << 12);
+
+        uint16_t v_pyro = adc_results[adc.sequenceIndex(adc_v_pyro.channel)];
+        last_v_pyro = (v_pyro * 2 * last_vdd) / (1 << 12);
+
+        uint16_t v_sense1 = adc_results[adc.sequenceIndex(adc_pyro_sense1.channel)];
+        last_pyro_sense1 = (v_sense1 * 2 * last_vdd) / (1 << 12);
+    }
+    // Runs in the background until the next time
+    adc.startScan();
 
     // TODO: fake pyro_2 readings for now
     last_pyro_sense2 = last_v_pyro;
 
-    if (baro_initialized && baro.dataReady()) {
-        baro.readPressure_u28q4(last_pressure);
+    if (baro_initialized && bus_i2c.waitRequest(&req_baro) && baro.sampleReady()) {
+        baro.samplePressure_u28q4(last_pressure);
         int16_t temp;
-        baro.readTemperature_12q4(temp);
+        baro.sampleTemperature_12q4(temp);
         last_temp_baro = temp - gCalibration.baro_temp_offset_q4;
 
         if (log_file_ok && is_armed) {
@@ -583,9 +631,9 @@ systime_t AppState::task_sensors(systime_t due_time) {
         last_time_baro = millis();
     }
 
-    if (mag_initialized && mag.dataReady()) {
+    if (mag_initialized && bus_i2c.waitRequest(&req_mag) && mag.sampleReady()) {
         int16_t m1, m2, m3;
-        mag.readMag(m1, m2, m3);
+        mag.sampleMag(m1, m2, m3);
         last_mx = m2 - gCalibration.mag_x_offset;
         last_my = -m1;
         last_mz = m3;            
@@ -622,9 +670,9 @@ systime_t AppState::task_sensors(systime_t due_time) {
         last_time_mag = millis();
     }
 
-    if (gyro_initialized && gyro.dataReady()) {
+    if (gyro_initialized && bus_i2c.waitRequest(&req_gyro) && gyro.sampleReady()) {
         int16_t wx, wy, wz, ax, ay, az;
-        gyro.readMeasurement(wx, wy, wz, ax, ay, az);
+        gyro.sampleMeasurement(wx, wy, wz, ax, ay, az);
         last_wx = -wx;
         last_wy = wy;
         last_wz = -wz;
@@ -632,7 +680,7 @@ systime_t AppState::task_sensors(systime_t due_time) {
         last_ay = ay;
         last_az = -az;
         int16_t temp;
-        gyro.readTemperature_12q4(temp);
+        gyro.sampleTemperature_12q4(temp);
         last_temp_gyro = temp - gSettings.gyro_temp_offset_q4;
 
         // trigger a new conversion
@@ -640,6 +688,42 @@ systime_t AppState::task_sensors(systime_t due_time) {
         last_time_gyro = millis();
     }
 
+    if (gyro_initialized) {
+        // Every IMU sample is logged from launch until shortly after the
+        // ejection, a decimated stream otherwise while armed
+        uint8_t fifo_dec = 0;
+        if (log_file_ok && is_armed) {
+            bool full_rate = (state == eFLIGHT) ||
+                (state == eRECOVERY && millis() - eject_time < IMU_FULL_RATE_AFTER_EJECT);
+            fifo_dec = full_rate ? LSM6DS33::eFIFO_DEC_1 : LSM6DS33::eFIFO_DEC_16;
+        }
+        if (fifo_dec != gyro_fifo_dec) {
+            // Restarting from bypass drops the samples buffered at the old rate
+            if (fifo_dec) {
+                gyro.setupFIFO(LSM6DS33::eFIFO_CONTINUOUS, LSM6DS33::eODR_G_104Hz, 2 * XLOG_IMU_MAX_SAMPLES, (LSM6DS33::fifo_dec_t)fifo_dec);
+            }
+            else {
+                gyro.setupFIFO(LSM6DS33::eFIFO_BYPASS, LSM6DS33::eODR_G_104Hz, 2 * XLOG_IMU_MAX_SAMPLES);
+            }
+            gyro_fifo_dec = fifo_dec;
+        }
+        if (fifo_dec) {
+            // Drain the IMU FIFO in bursts, at most XLOG_IMU_MAX_BATCHES per run,
+            // the rest is left for the next run
+            LSM6DS33::sample_t samples[XLOG_IMU_MAX_SAMPLES];
+            uint32_t now = millis();
+            uint32_t interval_us = gyro.fifoIntervalUs();
+            int pending = gyro.fifoLevel();
+            for (int batch = 0; batch < XLOG_IMU_MAX_BATCHES && pending > 0; batch++) {
+                int count = gyro.readFIFO(samples, (pending < XLOG_IMU_MAX_SAMPLES) ? pending : XLOG_IMU_MAX_SAMPLES);
+                if (count == 0) break;
+                pending -= count;
+                // Newest sample in the FIFO is taken as "now"
+                xlog_imu(now - (pending * interval_us) / 1000, interval_us, (const int16_t *)samples, count);
+            }
+        }
+    }
+
     return 100;
 }
 
@@ -669,6 +753,7 @@ systime_t AppState::task_control(systime_t due_time) {
         if (millis() >= timeout) {
             // Timer expired; unlock pyro
 
+            radio_pause();
             radio.sleep();
             delay(5);
             radio.setupFSK();
@@ -691,13 +776,12 @@ systime_t AppState::task_control(systime_t due_time) {
 
             radio.sleep();
             delay(5);
-            radio.setupLoRa(RFM96::ModemSettings()
-                .setSF(RFM96::eSF_10)
-                .setCR(RFM96::eCR_4_8)
-            );
+            radio.setupLoRa(radio_rate_settings(0));
             radio.setFrequencyHz(gSettings.radio_frequency);
+            radio_resume();
 
-            xlog_eject(millis());
+            eject_time = millis();
+            xlog_eject(eject_time);
             state = eRECOVERY;
         }
         break;
@@ -716,6 +800,14 @@ systime_t AppState::task_control(systime_t due_time) {
     return 200;
 }
 
+systime_t AppState::task_log(systime_t due_time) {
+    // Program buffered log pages in the background
+    if (log_file_ok) {
+        xlog_service();
+    }
+    return 10;
+}
+
 int AppState::free_space() {
     return xlog_free_space();
 }
\ No newline at end of file
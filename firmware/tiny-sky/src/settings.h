@@ -93,7 +93,7 @@ struct AppSettings {
         void        *value;
     };
 
-    param_descriptor_t params[8];
+    param_descriptor_t params[9];
 
     // User-editable settings
     char        radio_callsign[16];
@@ -102,6 +102,7 @@ struct AppSettings {
     int8_t      radio_tx_power;     // transmit power in dBm
     uint8_t     radio_tx_period;    // telemetry transmit period, seconds
     uint8_t     radio_tx_start;     // telemetry transmit offset, seconds
+    uint8_t     radio_adaptive;     // adaptive data rate (0 = fixed SF10)
     //uint8_t     radio_modem_type;   // LORA vs FSK etc
     //uint32_t    radio_bandwidth;    // channel bandwidth in Hz
 
@@ -154,6 +155,7 @@ struct AppState {
     bool    baro_initialized;
     bool    mag_initialized; 
     bool    gyro_initialized;
+    uint8_t gyro_fifo_dec;      // FIFO decimation while logging, 0 when the FIFO is off
 
     bool    mag_cal_enabled;
     systime_t mag_cal_start;
@@ -193,8 +195,11 @@ struct AppState {
     };
 
     State   state;
+    uint32_t eject_time;
 
-    //lfs_t               lfs;    
+    lfs_t               lfs;
+    bool                lfs_ok;
+    systime_t           lfs_mount_ms;   // time taken by the last mount (incl. format)
     //lfs_file_t          log_file;
     bool                log_file_ok;
 
@@ -207,6 +212,7 @@ struct AppState {
     I2C<I2C1, PB_9, PB_8>       bus_i2c;
 
     ADC<ADC1>           adc;
+    volatile uint16_t   adc_results[4];
 
     DigitalOut<PB_12>   statusLED;
     DigitalOut<PB_15>   buzzerOn;
@@ -221,6 +227,7 @@ struct AppState {
 
     DigitalIn<PA_7>     arm_sense;
 
+    DigitalIn<PB_10>    loraDIO0;
     DigitalOut<PC_13>   loraDIO2;
     DigitalOut<PA_9>    loraRST;
     DigitalOut<PA_10>   loraSS;
@@ -234,6 +241,10 @@ struct AppState {
     MPL3115             baro;
     LSM6DS33            gyro;
 
+    I2CRequest          req_mag;
+    I2CRequest          req_baro;
+    I2CRequest          req_gyro;
+
     AppState() : mag(bus_i2c), baro(bus_i2c), gyro(bus_i2c) {}
 
     int init_lfs();
@@ -243,6 +254,9 @@ struct AppState {
     int init_hw();
     int init_periph();
 
+    bool idle_stop_allowed();
+    void gps_setup_ubx();
+
     systime_t task_gps(systime_t due_time);
     systime_t task_console(systime_t due_time);
     systime_t task_report(systime_t due_time);
@@ -250,6 +264,7 @@ struct AppState {
     systime_t task_buzz(systime_t due_time);
     systime_t task_sensors(systime_t due_time);
     systime_t task_control(systime_t due_time);
+    systime_t task_log(systime_t due_time);
 };
 
 extern AppCalibration   gCalibration;
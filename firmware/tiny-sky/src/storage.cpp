@@ -1,10 +1,20 @@
 #include "storage.h"
 #include "settings.h"
+#include "crc.h"
+#include "lfs_flash.h"
 
 #include <ptlib/ptlib.h>
 
 #include <libopencm3/stm32/flash.h>
 
+#include <cstring>
+
+#define XLOG_START          0x2000
+#define XLOG_END            lfs_flash_start()     // depends on the detected flash size
+#define XLOG_PAGE_SIZE      256
+#define XLOG_BUFFER_PAGES   4
+#define XLOG_BUFFER_SIZE    (XLOG_BUFFER_PAGES * XLOG_PAGE_SIZE)
+
 int eeprom_write(uint32_t address, const uint32_t *data, int length_in_words)
 {
     // Wait until FLASH is not busy
@@ -42,10 +52,19 @@ int extflash_write(uint32_t address, const uint8_t *buffer, int size) {
     uint32_t page_remaining = 256 - (address & 0xFF);
     while (size > 0) {
         int wr_len = (size < page_remaining) ? size : page_remaining;
+        // A background erase is suspended rather than waited for, the page
+        // program must be complete before it can be resumed
+        bool suspended = gState.flash.eraseSuspend();
         while (gState.flash.busy()) {
             // idle wait
         }
         gState.flash.programPage(address, wr_buf, wr_len);
+        if (suspended) {
+            while (gState.flash.busy()) {
+                // idle wait
+            }
+            gState.flash.eraseResume();
+        }
         address += wr_len;
         wr_buf += wr_len;
         size -= wr_len;
@@ -55,40 +74,374 @@ int extflash_write(uint32_t address, const uint8_t *buffer, int size) {
 }
 
 int extflash_read(uint32_t address, uint8_t *buffer, int size) {
+    bool suspended = gState.flash.eraseSuspend();
     while (gState.flash.busy()) {
         // idle wait
     }
     gState.flash.read(address, buffer, size);
+    if (suspended) {
+        gState.flash.eraseResume();
+    }
     return 0;
 }
 
-static    uint32_t            log_size;
+// Log layout
+//
+// The log area is a sequence of 4 KB sectors, each one starting with a sector
+// header followed by framed records:
+//
+//   header: 'X' 'S' version first_seq boot[2] base_time[4] flags crc8
+//   record: tag length seq dt[2] payload[length] crc8
+//
+// dt is the record timestamp in ms relative to the base time of the sector
+// (or of the last XLOG_TAG_TIME record). seq counts records modulo 256, so
+// lost records are detectable. Records never cross a sector boundary, the
+// unused end of a sector stays erased (0xFF). Every boot starts a new sector,
+// so after corruption (e.g. a torn write at power loss) a reader can always 
+// resynchronize at the next sector.
+//
+// Baro and mag samples are delta compressed. Only the first sample of each 
+// kind is written as a full record (keyframe), the following ones are packed 
+// into XLOG_TAG_BLOCK records as differences to the previous sample:
+//
+//   entry: type:2 temp_changed:1 dt:5 [dt varint] value varint [temp varint]
+//
+// dt is the time since the previous entry in the block (the first one refers
+// to the block record time), values are zig-zag encoded varints. dt = 31 means
+// that the real (signed) time difference follows as a varint. The predictor 
+// is reset after every block and at every sector start, so each block only
+// depends on the keyframes written before it in the same sector.
+
+#define XLOG_SECTOR_SIZE        0x1000
+#define XLOG_HEADER_SIZE        12
+#define XLOG_HEADER_VERSION     2
+#define XLOG_FRAME_OVERHEAD     6
+#define XLOG_CRC_INIT           0xFF    // so that runs of zeros do not pass as valid frames
+
+#define XLOG_FLAG_DELTA         0x01    // sector may contain delta blocks
+
+#define XLOG_TAG_TIME           0x0F    // payload: new base time (u32)
+#define XLOG_TAG_BLOCK          0x20    // payload: delta coded entries
+
+#define XLOG_BLOCK_MAX          240     // maximum block payload
+#define XLOG_BLOCK_MAX_AGE      1000    // flush a pending block after this many ms
+
+#define XLOG_DELTA_BARO         0
+#define XLOG_DELTA_MAG          1
+
+static    uint32_t            log_size;       // bytes accepted into the log (incl. buffered)
+static    uint32_t            log_flushed;    // bytes already programmed to flash
+static    uint32_t            log_dropped;    // records lost due to full buffer/flash
+
+static    uint16_t            log_boot;       // boot counter written to sector headers
+static    uint32_t            log_time_base;  // base time for record timestamps
+static    uint8_t             log_seq;        // sequence number of the next record
+
+// Write-behind staging buffer, log addresses map to it modulo its size
+static    uint8_t             log_buffer[XLOG_BUFFER_SIZE];
+
+struct delta_state_t {
+    bool        valid;
+    int32_t     value;
+    int32_t     temp;
+};
+
+// Delta block being collected, it is appended to the log when full
+static    delta_state_t       delta_pred[2];
+static    uint8_t             block_buffer[XLOG_BLOCK_MAX];
+static    int                 block_length;
+static    int                 block_count;    // number of entries
+static    uint32_t            block_time;     // time of the first entry
+static    uint32_t            block_last;     // time of the last entry
+
+static void xlog_block_flush();
+
+// Copies data (or erased bytes if data is null) to the staging buffer
+static void xlog_put(const uint8_t *data, int size) {
+    uint32_t pos = log_size % XLOG_BUFFER_SIZE;
+    int part = XLOG_BUFFER_SIZE - pos;
+    if (part > size) part = size;
+    if (data) {
+        memcpy(log_buffer + pos, data, part);
+        memcpy(log_buffer, data + part, size - part);
+    }
+    else {
+        memset(log_buffer + pos, 0xFF, part);
+        memset(log_buffer, 0xFF, size - part);
+    }
+    log_size += size;
+}
 
-int xlog_init() {
-    uint32_t high = 0x200000 - 1;
-    uint32_t low  = 0x2000;
-    uint8_t  buffer[16];
+static void xlog_put_header(uint32_t base_time) {
+    uint8_t header[XLOG_HEADER_SIZE] = {
+        'X', 'S',
+        XLOG_HEADER_VERSION,
+        log_seq,
+        (uint8_t)(log_boot >> 0),
+        (uint8_t)(log_boot >> 8),
+        (uint8_t)(base_time >>  0),
+        (uint8_t)(base_time >>  8),
+        (uint8_t)(base_time >> 16),
+        (uint8_t)(base_time >> 24),
+        XLOG_FLAG_DELTA
+    };
+    header[XLOG_HEADER_SIZE - 1] = crc8_update(XLOG_CRC_INIT, header, XLOG_HEADER_SIZE - 1);
+    xlog_put(header, XLOG_HEADER_SIZE);
+    log_time_base = base_time;
 
-    while (low <= high) {
-        uint32_t middle = low + (high - low) / 2;
+    // Delta coding starts over in every sector
+    delta_pred[XLOG_DELTA_BARO].valid = false;
+    delta_pred[XLOG_DELTA_MAG].valid = false;
+}
 
-        extflash_read(middle, buffer, sizeof(buffer));
-        bool empty = true;
-        for (int i = 0; i < sizeof(buffer); i++) {
-            if (buffer[i] != 0xFF) {
-                empty = false;
-                break;
-            }
+static void xlog_put_frame(uint8_t tag, uint16_t dt, const uint8_t *payload, int length) {
+    uint8_t header[5] = {
+        tag, (uint8_t)length, log_seq, (uint8_t)(dt >> 0), (uint8_t)(dt >> 8)
+    };
+    uint8_t crc = crc8_update(XLOG_CRC_INIT, header, sizeof(header));
+    crc = crc8_update(crc, payload, length);
+    xlog_put(header, sizeof(header));
+    xlog_put(payload, length);
+    xlog_put(&crc, 1);
+    log_seq++;
+}
+
+// Returns false if the record had to be dropped
+static bool xlog_record(uint8_t tag, uint32_t timestamp, const uint8_t *payload, int length) {
+    uint32_t offset = log_size % XLOG_SECTOR_SIZE;
+    int size = XLOG_FRAME_OVERHEAD + length;
+
+    // Rebase the timestamps if the record would be too far from the base time
+    bool rebase = (offset != 0) && (timestamp - log_time_base > 0xFFFF);
+    if (rebase) size += XLOG_FRAME_OVERHEAD + 4;
+
+    // A pending block must still fit in the current sector after this record
+    // and keep the base time it was started with
+    if (tag != XLOG_TAG_BLOCK && block_length > 0) {
+        if (rebase || offset + size + XLOG_FRAME_OVERHEAD + block_length > XLOG_SECTOR_SIZE) {
+            xlog_block_flush();
+            return xlog_record(tag, timestamp, payload, length);
         }
+    }
+
+    // Start a new sector if the record does not fit in the current one
+    int pad = 0;
+    if (offset == 0 || offset + size > XLOG_SECTOR_SIZE) {
+        pad = (offset == 0) ? 0 : XLOG_SECTOR_SIZE - offset;
+        rebase = false;
+        size = pad + XLOG_HEADER_SIZE + XLOG_FRAME_OVERHEAD + length;
+    }
+
+    if ((log_size - log_flushed) + size > XLOG_BUFFER_SIZE || 
+        XLOG_START + log_size + size > XLOG_END) 
+    {
+        log_dropped++;
+        return false;
+    }
+
+    if (pad > 0) {
+        xlog_put(0, pad);
+    }
+    if (log_size % XLOG_SECTOR_SIZE == 0) {
+        xlog_put_header(timestamp);
+    }
+    if (rebase) {
+        uint8_t base[] = {
+            (uint8_t)(timestamp >>  0),
+            (uint8_t)(timestamp >>  8),
+            (uint8_t)(timestamp >> 16),
+            (uint8_t)(timestamp >> 24)
+        };
+        xlog_put_frame(XLOG_TAG_TIME, 0, base, sizeof(base));
+        log_time_base = timestamp;
+    }
+    xlog_put_frame(tag, timestamp - log_time_base, payload, length);
+    return true;
+}
+
+static int put_varint(uint8_t *ptr, uint32_t value) {
+    int length = 0;
+    while (value >= 0x80) {
+        ptr[length++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    ptr[length++] = (uint8_t)value;
+    return length;
+}
+
+static uint32_t zigzag(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+static void xlog_block_flush() {
+    if (block_length == 0) return;
+    if (!xlog_record(XLOG_TAG_BLOCK, block_time, block_buffer, block_length)) {
+        log_dropped += block_count - 1;
+    }
+    block_length = 0;
+    block_count = 0;
+
+    // Next samples start from a keyframe again
+    delta_pred[XLOG_DELTA_BARO].valid = false;
+    delta_pred[XLOG_DELTA_MAG].valid = false;
+}
+
+// Adds a sample to the delta block. Returns false if it has to be written as
+// a keyframe instead.
+static bool xlog_block_add(int type, uint32_t timestamp, int32_t value, int32_t temp) {
+    delta_state_t &pred = delta_pred[type];
+    if (!pred.valid) return false;
+
+    uint8_t entry[16];
+    int length = 1;
+    int32_t dt = (block_length > 0) ? (int32_t)(timestamp - block_last) : 0;
+    entry[0] = type << 6;
+    if (temp != pred.temp) entry[0] |= 0x20;
+    if (dt >= 0 && dt < 31) {
+        entry[0] |= dt;
+    }
+    else {
+        entry[0] |= 31;
+        length += put_varint(entry + length, zigzag(dt));
+    }
+    length += put_varint(entry + length, zigzag(value - pred.value));
+    if (temp != pred.temp) {
+        length += put_varint(entry + length, zigzag(temp - pred.temp));
+    }
+
+    uint32_t offset = log_size % XLOG_SECTOR_SIZE;
+    if (block_length == 0) {
+        // The block record must go to the current sector without rebasing
+        if (offset == 0 || timestamp - log_time_base > 0xFFFF) return false;
+    }
+    if (block_length + length > XLOG_BLOCK_MAX || 
+        offset + XLOG_FRAME_OVERHEAD + block_length + length > XLOG_SECTOR_SIZE) 
+    {
+        xlog_block_flush();
+        return false;
+    }
+
+    if (block_length == 0) {
+        block_time = timestamp;
+    }
+    memcpy(block_buffer + block_length, entry, length);
+    block_length += length;
+    block_count++;
+    block_last = timestamp;
+
+    pred.value = value;
+    pred.temp = temp;
+    return true;
+}
+
+static void xlog_block_key(int type, int32_t value, int32_t temp) {
+    delta_pred[type].valid = true;
+    delta_pred[type].value = value;
+    delta_pred[type].temp = temp;
+}
+
+// Programs the next chunk of buffered data up to the page boundary.
+// Flash must not be busy. Partial pages are only written if requested.
+static bool xlog_program_chunk(bool partial) {
+    uint32_t pending = log_size - log_flushed;
+    uint32_t address = XLOG_START + log_flushed;
+    uint32_t length  = XLOG_PAGE_SIZE - (address % XLOG_PAGE_SIZE);
+    if (pending < length) {
+        if (!partial || pending == 0) return false;
+        length = pending;
+    }
+    if (gState.flash.erasing()) {
+        // Wait for xlog_erase_log() to complete
+        return false;
+    }
+    gState.flash.programPage(address, log_buffer + (log_flushed % XLOG_BUFFER_SIZE), length);
+    log_flushed += length;
+    return true;
+}
 
-        if (empty) {
-            high = middle - 1;
+int xlog_service() {
+    if (block_length > 0 && millis() - block_time > XLOG_BLOCK_MAX_AGE) {
+        xlog_block_flush();
+    }
+
+    // Programming buffered pages takes precedence over a background erase,
+    // which only continues when there is no full page to program
+    uint32_t address = XLOG_START + log_flushed;
+    if (log_size - log_flushed >= XLOG_PAGE_SIZE - (address % XLOG_PAGE_SIZE)) {
+        if (gState.flash.busy()) {
+            return 0;
+        }
+        if (xlog_program_chunk(false)) {
+            return 1;
+        }
+    }
+    gState.flash.erasePoll();
+    return 0;
+}
+
+int xlog_sync() {
+    xlog_block_flush();
+    // Buffered data is only programmed after a background erase
+    while (gState.flash.erasePoll()) {
+        // idle wait
+    }
+    do {
+        while (gState.flash.busy()) {
+            // idle wait
+        }
+    } while (xlog_program_chunk(true));
+    while (gState.flash.busy()) {
+        // idle wait
+    }
+    return 0;
+}
+
+static bool xlog_header_valid(const uint8_t *header) {
+    return (header[0] == 'X' && header[1] == 'S' && 
+        header[XLOG_HEADER_SIZE - 1] == crc8_update(XLOG_CRC_INIT, header, XLOG_HEADER_SIZE - 1));
+}
+
+static bool xlog_header_erased(const uint8_t *header) {
+    for (int i = 0; i < XLOG_HEADER_SIZE; i++) {
+        if (header[i] != 0xFF) return false;
+    }
+    return true;
+}
+
+int xlog_init() {
+    // Sectors are used in order, so binary search for the first one with an
+    // erased header. Only sector headers need to be read.
+    uint32_t low  = 0;
+    uint32_t high = (XLOG_END - XLOG_START) / XLOG_SECTOR_SIZE;
+    uint8_t  header[XLOG_HEADER_SIZE];
+
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        extflash_read(XLOG_START + middle * XLOG_SECTOR_SIZE, header, sizeof(header));
+        if (xlog_header_erased(header)) {
+            high = middle;
         }
         else {
             low = middle + 1;
         }
     }
-    log_size = low - 0x2000;
+
+    // Appending continues from the next unused sector
+    log_size = low * XLOG_SECTOR_SIZE;
+    log_flushed = log_size;
+    log_seq = 0;
+    block_length = 0;
+    block_count = 0;
+
+    // Continue the boot counter from the last valid sector header
+    log_boot = 0;
+    for (uint32_t sector = low; sector > 0 && low - sector < 4; sector--) {
+        extflash_read(XLOG_START + (sector - 1) * XLOG_SECTOR_SIZE, header, sizeof(header));
+        if (xlog_header_valid(header)) {
+            log_boot = (header[4] | (header[5] << 8)) + 1;
+            break;
+        }
+    }
 
     // // mount the filesystem
     // int err = lfs_mount(&lfs, &lfs_cfg);
@@ -105,85 +458,89 @@ int xlog_init() {
 }
 
 int xlog_erase_log() {
-    while (gState.flash.busy()) {
-        // idle wait
+    // The used sectors are erased in the background (polled by xlog_service),
+    // from the last one down. New records are buffered meanwhile, nothing is
+    // programmed before the whole erase is complete. The used sectors thus
+    // always stay one block from the start, if power is lost before the erase
+    // is complete, the remains of the old log are found again at the next
+    // boot.
+    uint32_t length = (log_size + XLOG_SECTOR_SIZE - 1) & ~(XLOG_SECTOR_SIZE - 1);
+    if (length > 0) {
+        gState.flash.eraseStart(XLOG_START, length);
     }
-    for (uint32_t address = 0x2000; address < 0x2000 + log_size; address += 0x1000) {
-        gState.flash.eraseSector(address);
-        while (gState.flash.busy()) {
-            // idle wait
-        }
-    }
-    log_size = 0;    
+    log_size = 0;
+    log_flushed = 0;
+    log_dropped = 0;
+    log_seq = 0;
+    block_length = 0;
+    block_count = 0;
+    return 0;
+}
+
+int xlog_read(uint32_t offset, uint8_t *buffer, int size) {
+    // Only data already programmed to flash is visible, use xlog_sync() first
+    if (offset >= log_flushed) return 0;
+    if (size > log_flushed - offset) size = log_flushed - offset;
+    extflash_read(XLOG_START + offset, buffer, size);
+    return size;
 }
 
 int xlog_free_space() {
-    return 0x200000 - (0x1000 + log_size);
+    return (XLOG_END - XLOG_START) - log_size;
 }
 
 int xlog_used_space() {
     return log_size;
 }
 
+int xlog_dropped_records() {
+    return log_dropped;
+}
+
 void xlog_arm(uint32_t timestamp, uint8_t hour, uint8_t minute, uint8_t second) {
-    uint8_t buffer[] = {
-        0x00,
-        (uint8_t)(timestamp >>  0),
-        (uint8_t)(timestamp >>  8),
-        (uint8_t)(timestamp >> 16),
-        (uint8_t)(timestamp >> 24),
+    uint8_t payload[] = {
         hour,
         minute,
         second
     };
-    extflash_write(0x2000 + log_size, buffer, sizeof(buffer));
-    log_size += sizeof(buffer);    
+    xlog_record(0x00, timestamp, payload, sizeof(payload));
 }
 
 void xlog_mag(uint32_t timestamp, int16_t mag_x, int16_t temp_q4) {
-    uint8_t buffer[] = {
-        0x02,
-        (uint8_t)(timestamp >>  0),
-        (uint8_t)(timestamp >>  8),
-        (uint8_t)(timestamp >> 16),
-        (uint8_t)(timestamp >> 24),
+    int8_t temp = (temp_q4 + 8) >> 4;
+    if (xlog_block_add(XLOG_DELTA_MAG, timestamp, mag_x, temp)) return;
+
+    uint8_t payload[] = {
         (uint8_t)(mag_x >>  0),
         (uint8_t)(mag_x >>  8),
-        (uint8_t)((temp_q4 + 8) >> 4)
+        (uint8_t)temp
     };
-    //lfs_file_write(&lfs, &log_file, buffer, sizeof(buffer));
-    extflash_write(0x2000 + log_size, buffer, sizeof(buffer));
-    log_size += sizeof(buffer);
+    if (xlog_record(0x02, timestamp, payload, sizeof(payload))) {
+        xlog_block_key(XLOG_DELTA_MAG, mag_x, temp);
+    }
 }
 
 void xlog_baro(uint32_t timestamp, uint32_t pressure_q4, int16_t temp_q4) {
     // Convert to units of 2 Pa
     uint16_t pressure2 = ((pressure_q4 + 8) >> 4) / 2;
-    uint8_t buffer[] = {
-        0x01,
-        (uint8_t)(timestamp >>  0),
-        (uint8_t)(timestamp >>  8),
-        (uint8_t)(timestamp >> 16),
-        (uint8_t)(timestamp >> 24),
+    int8_t temp = (temp_q4 + 8) >> 4;
+    if (xlog_block_add(XLOG_DELTA_BARO, timestamp, pressure2, temp)) return;
+
+    uint8_t payload[] = {
         (uint8_t)(pressure2 >>  0),
         (uint8_t)(pressure2 >>  8),
-        (uint8_t)((temp_q4 + 8) >> 4)
+        (uint8_t)temp
     };
-    //lfs_file_write(&lfs, &log_file, buffer, sizeof(buffer));
-    extflash_write(0x2000 + log_size, buffer, sizeof(buffer));
-    log_size += sizeof(buffer);    
+    if (xlog_record(0x01, timestamp, payload, sizeof(payload))) {
+        xlog_block_key(XLOG_DELTA_BARO, pressure2, temp);
+    }
 }
 
 void xlog_pos(uint32_t timestamp, float latitude, float longitude, float altitude) {
     uint16_t alt = altitude;
     uint32_t lat = latitude * 10 * 1000 * 1000;
     uint32_t lon = longitude * 10 * 1000 * 1000;
-    uint8_t buffer[] = {
-        0x04,
-        (uint8_t)(timestamp >>  0),
-        (uint8_t)(timestamp >>  8),
-        (uint8_t)(timestamp >> 16),
-        (uint8_t)(timestamp >> 24),
+    uint8_t payload[] = {
         (uint8_t)(alt >> 0),
         (uint8_t)(alt >> 8),
         (uint8_t)(lat >>  0),
@@ -195,133 +552,26 @@ void xlog_pos(uint32_t timestamp, float latitude, float longitude, float altitud
         (uint8_t)(lon >> 16),
         (uint8_t)(lon >> 24)
     };
-    extflash_write(0x2000 + log_size, buffer, sizeof(buffer));
-    log_size += sizeof(buffer);   
+    xlog_record(0x04, timestamp, payload, sizeof(payload));
 }
 
-void xlog_eject(uint32_t timestamp) {
-    uint8_t buffer[] = {
-        0x10,
-        (uint8_t)(timestamp >>  0),
-        (uint8_t)(timestamp >>  8),
-        (uint8_t)(timestamp >> 16),
-        (uint8_t)(timestamp >> 24)
-    };
-    extflash_write(0x2000 + log_size, buffer, sizeof(buffer));
-    log_size += sizeof(buffer);   
+// Batch of IMU samples, each one is gx,gy,gz,ax,ay,az. 
+// The timestamp refers to the last sample in the batch.
+void xlog_imu(uint32_t timestamp, uint16_t interval_us, const int16_t *samples, int count) {
+    uint8_t payload[3 + XLOG_IMU_MAX_SAMPLES * 12];
+    if (count > XLOG_IMU_MAX_SAMPLES) count = XLOG_IMU_MAX_SAMPLES;
+
+    payload[0] = (uint8_t)count;
+    payload[1] = (uint8_t)(interval_us >> 0);
+    payload[2] = (uint8_t)(interval_us >> 8);
+    uint8_t *ptr = payload + 3;
+    for (int i = 0; i < count * 6; i++) {
+        *ptr++ = (uint8_t)(samples[i] >> 0);
+        *ptr++ = (uint8_t)(samples[i] >> 8);
+    }
+    xlog_record(0x05, timestamp, payload, ptr - payload);
 }
 
-// extern "C" {
-//     static int spi_flash_lfs_read(const struct lfs_config *c, lfs_block_t block, 
-//         lfs_off_t off, void *buffer, lfs_size_t size);
-
-//     static int spi_flash_lfs_prog(const struct lfs_config *c, lfs_block_t block, 
-//         lfs_off_t off, const void *buffer, lfs_size_t size);
-
-//     static int spi_flash_lfs_erase(const struct lfs_config *c, lfs_block_t block);
-
-//     static int spi_flash_lfs_sync(const struct lfs_config *c);
-// }
-
-
-// #define LFS_BLOCK_SIZE      4096
-// #define LFS_BLOCK_COUNT     512         // 16 Mbit
-
-// #define LFS_READ_SIZE       16
-// #define LFS_PROG_SIZE       (2 * LFS_READ_SIZE)
-
-// uint8_t lfs_read_buffer[LFS_READ_SIZE];
-// uint8_t lfs_prog_buffer[LFS_PROG_SIZE];
-// uint8_t lfs_file_buffer[LFS_PROG_SIZE];
-// uint8_t lfs_lookahead_buffer[16];
-
-// // configuration of the filesystem is provided by this struct
-// const lfs_config lfs_cfg = {
-//     .context = 0,
-
-//     // block device operations
-//     .read  = spi_flash_lfs_read,
-//     .prog  = spi_flash_lfs_prog,
-//     .erase = spi_flash_lfs_erase,
-//     .sync  = spi_flash_lfs_sync,
-
-//     // block device configuration
-//     .read_size = LFS_READ_SIZE,    // Minimum size of a block read
-//     .prog_size = LFS_PROG_SIZE,    // Minimum size of a block program
-//     .block_size = LFS_BLOCK_SIZE,  // Size of an erasable block, N*prog_size
-//     .block_count = LFS_BLOCK_COUNT,// Number of erasable blocks on the device
-//     .lookahead = 128, // Number of blocks to lookahead during block allocation, N*32
-
-//     .read_buffer = lfs_read_buffer,
-//     .prog_buffer = lfs_prog_buffer,
-//     .lookahead_buffer = lfs_lookahead_buffer,
-//     .file_buffer = lfs_file_buffer
-// };
-
-
-
-// static int spi_flash_lfs_read(const struct lfs_config *c, lfs_block_t block, 
-//     lfs_off_t off, void *buffer, lfs_size_t size) 
-// {
-//     uint32_t address = (block * LFS_BLOCK_SIZE) | off;
-
-//     while (gState.flash.busy()) {
-//         // idle wait
-//     }
-//     gState.flash.read(address, (uint8_t *)buffer, size);
-//     return 0;
-// }
-
-// static int spi_flash_lfs_prog(const struct lfs_config *c, lfs_block_t block, 
-//     lfs_off_t off, const void *buffer, lfs_size_t size) 
-// {
-//     uint32_t address = (block * LFS_BLOCK_SIZE) | off;
-//     const uint8_t *wr_buf = (const uint8_t *)buffer;
-
-//     uint32_t page_remaining = 256 - (address & 0xFF);
-//     while (size > 0) {
-//         int wr_len = (size < page_remaining) ? size : page_remaining;
-//         while (gState.flash.busy()) {
-//             // idle wait
-//         }
-//         gState.flash.programPage(address, wr_buf, wr_len);
-//         address += wr_len;
-//         wr_buf += wr_len;
-//         size -= wr_len;
-//         page_remaining = 256;
-//     }
-//     return 0;
-// }
-
-// static int spi_flash_lfs_erase(const struct lfs_config *c, lfs_block_t block) 
-// {
-//     uint32_t address = (block * LFS_BLOCK_SIZE);
-
-//     while (gState.flash.busy()) {
-//         // idle wait
-//     }
-//     gState.flash.eraseSector(address);
-//     return 0;
-// }
-
-// static int spi_flash_lfs_sync(const struct lfs_config *c) {
-//     while (gState.flash.busy()) {
-//         // idle wait
-//     }
-//     // Nothing to sync here, indicate success
-//     return 0;
-// }
-
-// static int _traverse_df_cb(void *p, lfs_block_t block){
-// 	uint32_t *nb = (uint32_t *)p;
-// 	*nb += 1;
-// 	return 0;
-// }
-
-// int AppState::free_space(){
-	// uint32_t n_allocated = 0;
-	// int err = lfs_traverse(&lfs, _traverse_df_cb, &n_allocated);
-	// if (err < 0) {
-	// 	return err;
-	// }
-// }
\ No newline at end of file
+void xlog_eject(uint32_t timestamp) {
+    xlog_record(0x10, timestamp, 0, 0);
+}
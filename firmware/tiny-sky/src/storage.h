@@ -2,19 +2,28 @@
 
 #include <stdint.h>
 
+// Maximum number of samples in one IMU batch record
+#define XLOG_IMU_MAX_SAMPLES    16
+// Maximum number of IMU batch records logged per sensor task run
+#define XLOG_IMU_MAX_BATCHES    4
+
 void xlog_arm(uint32_t timestamp, uint8_t hour, uint8_t minute, uint8_t second);
 void xlog_pos(uint32_t timestamp, float latitude, float longitude, float altitude);
 void xlog_mag(uint32_t timestamp, int16_t mag_x, int16_t temp_q4);
 void xlog_baro(uint32_t timestamp, uint32_t pressure_q4, int16_t temp_q4);
-void xlog_gyro();
+void xlog_imu(uint32_t timestamp, uint16_t interval_us, const int16_t *samples, int count);
 void xlog_eject(uint32_t timestamp);
 
 int xlog_init();
+int xlog_service();
+int xlog_sync();
 
 int xlog_free_space();
 int xlog_used_space();
+int xlog_dropped_records();
 
 int xlog_erase_log();
+int xlog_read(uint32_t offset, uint8_t *buffer, int size);
 
 int eeprom_write(uint32_t address, uint32_t *data, int length_in_words);
 int extflash_write(uint32_t address, const uint8_t *buffer, int size);
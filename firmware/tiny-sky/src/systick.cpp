@@ -1,11 +1,21 @@
 #include <libopencm3/stm32/rcc.h>
 #include <libopencm3/cm3/nvic.h>
+#include <libopencm3/cm3/cortex.h>
 #include <libopencm3/cm3/systick.h>
+#include <libopencm3/cm3/scb.h>
+#include <libopencm3/stm32/lptimer.h>
+#include <libopencm3/stm32/exti.h>
+#include <libopencm3/stm32/pwr.h>
 
 #include "systick.h"
 
 #define SYSTICK_HZ      1000
 
+#define TICKLESS_MIN_MS     3       // don't bother stopping the tick for shorter idle periods
+#define TICKLESS_MAX_MS     1000    // must fit into 16-bit LPTIM counter at LSI frequency
+
+#define EXTI_LINE_LPTIM1    (1UL << 29)
+
 static volatile uint32_t system_millis;
 
 // struct timer_t {
@@ -59,62 +69,261 @@ extern "C" {
     }
 }
 
-static timer_task_t *first_task;
+#define MAX_TASKS       16
 
-static void insert_task(timer_task_t *task, systime_t due_time) {
-    task->due_time = due_time;
-    if (!first_task) {
-        first_task = task;
-        task->next = 0;
-        return;
+// Binary min-heap of pending tasks ordered by due time (then by priority)
+static timer_task_t *task_heap[MAX_TASKS];
+static int          task_heap_size;
+static int          task_heap_reserved;     // slots held for the tasks run in the current pass
+
+// All tasks ever added, for reporting
+static timer_task_t *task_list[MAX_TASKS];
+static int          task_list_size;
+
+static bool task_before(const timer_task_t *a, const timer_task_t *b) {
+    int32_t diff = (int32_t)(a->due_time - b->due_time);
+    if (diff != 0) return (diff < 0);
+    return (a->priority > b->priority);
+}
+
+static void heap_swap(int i, int j) {
+    timer_task_t *tmp = task_heap[i];
+    task_heap[i] = task_heap[j];
+    task_heap[j] = tmp;
+}
+
+static void heap_sift_up(int idx) {
+    while (idx > 0) {
+        int parent = (idx - 1) / 2;
+        if (!task_before(task_heap[idx], task_heap[parent])) break;
+        heap_swap(idx, parent);
+        idx = parent;
     }
-    timer_task_t *task_iter = first_task;
-    timer_task_t *task_iter_prev = 0;
-    while (task_iter) {
-        if (task_iter->due_time > task->due_time || 
-            (task_iter->due_time == task->due_time && task_iter->priority <= task->priority)) 
-        {
-            task->next = task_iter;
-            if (task_iter_prev) {
-                task_iter_prev->next = task;
-            }
-            else {
-                first_task = task;
-            }
-            return;
-        }
-        task_iter_prev = task_iter;
-        task_iter = task_iter->next;
+}
+
+static void heap_sift_down(int idx) {
+    while (true) {
+        int left  = 2 * idx + 1;
+        int right = left + 1;
+        int first = idx;
+        if (left < task_heap_size && task_before(task_heap[left], task_heap[first])) first = left;
+        if (right < task_heap_size && task_before(task_heap[right], task_heap[first])) first = right;
+        if (first == idx) break;
+        heap_swap(idx, first);
+        idx = first;
+    }
+}
+
+static bool insert_task(timer_task_t *task, systime_t due_time) {
+    if (task_heap_size + task_heap_reserved >= MAX_TASKS) return false;
+    task->due_time = due_time;
+    task_heap[task_heap_size] = task;
+    heap_sift_up(task_heap_size);
+    task_heap_size++;
+    return true;
+}
+
+static timer_task_t * remove_first_task() {
+    timer_task_t *task = task_heap[0];
+    task_heap_size--;
+    if (task_heap_size > 0) {
+        task_heap[0] = task_heap[task_heap_size];
+        heap_sift_down(0);
     }
-    // We should add the new item at the end
-    task_iter_prev->next = task;
-    task->next = 0;
+    return task;
 }
 
-void add_task(timer_task_t *task, timer_routine_t routine, systime_t due_time, int priority) {
+bool add_task(timer_task_t *task, timer_routine_t routine, systime_t due_time, int priority, const char *name) {
+    bool listed = false;
+    for (int i = 0; i < task_list_size; i++) {
+        if (task_list[i] == task) listed = true;
+    }
+    if (!listed && task_list_size >= MAX_TASKS) return false;
+
     task->routine = routine;
     task->priority = priority;
-    insert_task(task, due_time);
+    task->name = name;
+    task->run_count = 0;
+    task->late_sum = 0;
+    task->late_max = 0;
+    task->overruns = 0;
+    if (!insert_task(task, due_time)) return false;
+
+    if (!listed) task_list[task_list_size++] = task;
+    return true;
 }
 
 void schedule_tasks() {
-    if (!first_task) return;
-    if (millis() >= first_task->due_time) {
-        systime_t interval = first_task->routine(first_task->due_time);
-        systime_t due_next = first_task->due_time + interval;
+    // Run every task that is overdue now, but each one at most once per pass,
+    // so that a task that keeps falling behind cannot starve the others. Tasks
+    // go back into the heap only after the pass. Their slots stay reserved
+    // meanwhile, so a routine adding a task cannot take them.
+    timer_task_t *ran[MAX_TASKS];
+    int n_ran = 0;
+    systime_t now = millis();
+
+    while (task_heap_size > 0) {
+        timer_task_t *task = task_heap[0];
+        if ((int32_t)(now - task->due_time) < 0) break;
 
-        timer_task_t *task = first_task;
+        remove_first_task();
+        task_heap_reserved++;
 
-        // Remove task from the queue
-        first_task = first_task->next;
-        task->next = 0;
-        //if (first_task) {
-            //first_task->prev = 0;
-        //}
+        systime_t late = millis() - task->due_time;
+        task->run_count++;
+        task->late_sum += late;
+        if (late > task->late_max) task->late_max = late;
+
+        systime_t interval = task->routine(task->due_time);
 
         if (interval > 0) {
             // Reschedule the task in the queue
-            insert_task(task, due_next);
+            systime_t due_next = task->due_time + interval;
+            if ((int32_t)(millis() - due_next) >= 0) {
+                task->overruns++;
+            }
+            task->due_time = due_next;
+            ran[n_ran++] = task;
         }
+        else {
+            task_heap_reserved--;
+        }
+    }
+
+    // Can't fail, each one gives back its own reserved slot
+    for (int i = 0; i < n_ran; i++) {
+        task_heap_reserved--;
+        insert_task(ran[i], ran[i]->due_time);
+    }
+}
+
+int task_count() {
+    return task_list_size;
+}
+
+const timer_task_t * task_get(int index) {
+    if (index < 0 || index >= task_list_size) return 0;
+    return task_list[index];
+}
+
+void task_stats_reset() {
+    for (int i = 0; i < task_list_size; i++) {
+        task_list[i]->run_count = 0;
+        task_list[i]->late_sum = 0;
+        task_list[i]->late_max = 0;
+        task_list[i]->overruns = 0;
+    }
+}
+
+
+// Tickless idle
+//
+// LPTIM1 runs continuously from LSI (which keeps running in STOP mode) and is
+// used as a wake-up timer while the SysTick interrupt is suspended. The time 
+// spent sleeping is measured on LPTIM1 and added to system_millis on wake-up.
+
+static bool     tickless_enabled;
+static uint32_t lptim_hz;           // measured LSI frequency
+static uint32_t idle_frac_us;       // sub-millisecond remainder carried between idle periods
+
+static uint16_t lptim_read() {
+    // Counter is clocked asynchronously, so read until two consecutive values match
+    uint16_t cnt1, cnt2;
+    cnt1 = lptimer_get_counter(LPTIM1);
+    do {
+        cnt2 = cnt1;
+        cnt1 = lptimer_get_counter(LPTIM1);
+    } while (cnt1 != cnt2);
+    return cnt1;
+}
+
+void tickless_setup(void)
+{
+    rcc_osc_on(RCC_LSI);
+    rcc_wait_for_osc_ready(RCC_LSI);
+
+    rcc_set_lptim1_sel(RCC_CCIPR_LPTIM1SEL_LSI);
+    rcc_periph_clock_enable(RCC_LPTIM1);
+
+    lptimer_set_internal_clock_source(LPTIM1);
+    lptimer_enable(LPTIM1);
+    lptimer_set_period(LPTIM1, 0xFFFF);
+    lptimer_start_counter(LPTIM1, LPTIM_CR_CNTSTRT);
+
+    // LSI is only accurate to about 10%, so calibrate it against SysTick (HSI16)
+    systime_t start = millis();
+    while (millis() == start) { ; }
+    uint16_t cnt_start = lptim_read();
+    delay(100);
+    uint16_t cnt_end = lptim_read();
+    lptim_hz = 10UL * (uint16_t)(cnt_end - cnt_start);
+    if (lptim_hz == 0) return;
+
+    // Wake up from STOP mode requires the LPTIM1 EXTI line to be unmasked
+    EXTI_IMR |= EXTI_LINE_LPTIM1;
+    lptimer_enable_irq(LPTIM1, LPTIM_IER_CMPMIE);
+    nvic_enable_irq(NVIC_LPTIM1_IRQ);
+
+    // Wake up from STOP on HSI16 (our system clock), use low power regulator
+    RCC_CFGR |= RCC_CFGR_STOPWUCK;
+    PWR_CR |= PWR_CR_LPSDSR | PWR_CR_ULP;
+
+    idle_frac_us = 0;
+    tickless_enabled = true;
+}
+
+void systick_idle(bool allow_stop)
+{
+    int32_t idle_ms = TICKLESS_MAX_MS;
+    if (task_heap_size > 0) {
+        idle_ms = (int32_t)(task_heap[0]->due_time - millis());
+    }
+
+    if (!tickless_enabled || idle_ms < TICKLESS_MIN_MS) {
+        __asm("WFI");
+        return;
+    }
+    if (idle_ms > TICKLESS_MAX_MS) idle_ms = TICKLESS_MAX_MS;
+
+    // Interrupts stay masked until the time is accounted for, so that the
+    // interrupt that woke us up sees the correct millis(). A pending interrupt
+    // still ends WFI.
+    cm_disable_interrupts();
+
+    // Suspend the tick, keeping the part of the current millisecond already elapsed
+    systick_interrupt_disable();
+    uint32_t reload = systick_get_reload();
+    uint32_t tick_us = ((reload - systick_get_value()) * 1000UL) / (reload + 1);
+
+    uint16_t cnt_start = lptim_read();
+    uint32_t idle_ticks = ((idle_ms * 1000UL - tick_us - idle_frac_us) * (uint64_t)lptim_hz) / 1000000UL;
+    lptimer_clear_flag(LPTIM1, LPTIM_ICR_CMPMCF | LPTIM_ICR_CMPOKCF);
+    lptimer_set_compare(LPTIM1, (uint16_t)(cnt_start + idle_ticks));
+    while (!lptimer_get_flag(LPTIM1, LPTIM_ISR_CMPOK)) { ; }
+
+    if (allow_stop) {
+        PWR_CR |= PWR_CR_CWUF;
+        SCB_SCR |= SCB_SCR_SLEEPDEEP;
+    }
+    __asm("WFI");
+    SCB_SCR &= ~SCB_SCR_SLEEPDEEP;
+
+    // Account for the time spent asleep (we may have been woken early by another interrupt)
+    uint16_t idle_elapsed = lptim_read() - cnt_start;
+    uint32_t elapsed_us = tick_us + idle_frac_us + (idle_elapsed * 1000000ULL) / lptim_hz;
+    system_millis += elapsed_us / 1000;
+    idle_frac_us = elapsed_us % 1000;
+
+    // Restart the tick with a full period
+    systick_clear();
+    systick_interrupt_enable();
+    cm_enable_interrupts();
+}
+
+extern "C" {
+    void lptim1_isr(void)
+    {
+        // Only needed to wake up the core, time is accounted in systick_idle()
+        lptimer_clear_flag(LPTIM1, LPTIM_ICR_CMPMCF);
     }
 }
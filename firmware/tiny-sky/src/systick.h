@@ -5,6 +5,9 @@ typedef uint32_t systime_t;
 
 void systick_setup(void);
 
+void tickless_setup(void);
+void systick_idle(bool allow_stop);
+
 void delay(uint32_t delay);
 void delay_us(uint32_t delay);
 
@@ -17,9 +20,20 @@ struct timer_task_t {
     systime_t       due_time;
     timer_routine_t routine;
     int             priority;
-    timer_task_t    *next;
+    const char      *name;
+
+    // Deadline statistics (lateness = millis() - due_time at the time of call)
+    uint32_t        run_count;
+    uint32_t        late_sum;   // milliseconds
+    systime_t       late_max;   // milliseconds
+    uint32_t        overruns;   // next due time already passed when the routine returned
 };
 
-void add_task(timer_task_t *task, timer_routine_t routine, systime_t due_tie = 0, int priority = 0);
+// Returns false if there is no room for another task
+bool add_task(timer_task_t *task, timer_routine_t routine, systime_t due_tie = 0, int priority = 0, const char *name = 0);
 
 void schedule_tasks();
+
+int  task_count();
+const timer_task_t * task_get(int index);
+void task_stats_reset();
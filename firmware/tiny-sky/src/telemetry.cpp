@@ -5,6 +5,8 @@
 
 #include "strconv.h"
 
+#include <lora/telemetry_frame.h>
+
 // void TeleMessage::restore() {
 //     uint16_t test;
 //     EEPROM.get(0x00, test);
@@ -98,3 +100,51 @@ bool TeleMessage::build_string(char *buf, int &buf_len) {
     return false;
     //return (buf_req < buf_len); // true if buf had sufficient space
 }
+
+// Scales to a signed 24-bit value with range = 2^23
+static int32_t to_fixed24(float value, float range) {
+    float scaled = value * (8388608.0f / range);
+    if (scaled >= 8388607.0f) return 8388607;
+    if (scaled <= -8388607.0f) return -8388607;
+    return (int32_t)(scaled + ((scaled >= 0) ? 0.5f : -0.5f));
+}
+
+static uint8_t clip_u8(uint32_t value) {
+    return (value > 255) ? 255 : value;
+}
+
+bool TeleMessage::build_binary(uint8_t *buf, int &buf_len) {
+    using namespace telemetry_frame;
+
+    if (buf_len < TELEMETRY_FRAME_LENGTH) return false;
+
+    int32_t  lat_fixed = 0;
+    int32_t  lng_fixed = 0;
+    uint16_t alt_m = 0;
+    uint8_t  flags = (pyro_state & (TELEMETRY_FLAG_PYRO1 | TELEMETRY_FLAG_PYRO2));
+    if (fixValid) {
+        lat_fixed = to_fixed24(lat, 90);
+        lng_fixed = to_fixed24(lng, 180);
+        if (alt > 65535) alt_m = 65535;
+        else if (alt > 0) alt_m = (uint16_t)(0.5f + alt);
+        flags |= TELEMETRY_FLAG_FIX;
+    }
+    flags |= (flight_state << TELEMETRY_STATE_SHIFT) & TELEMETRY_STATE_MASK;
+
+    buf[0] = TELEMETRY_FRAME_MAGIC;
+    buf[1] = payload_id(callsign, sizeof(callsign));
+    put_u16(buf + 2, msg_id);
+    put_u24(buf + 4, hour * 3600UL + minute * 60 + second);
+    put_u24(buf + 7, lat_fixed);
+    put_u24(buf + 10, lng_fixed);
+    put_u16(buf + 13, alt_m);
+    buf[15] = n_sats;
+    buf[16] = temperature_int;
+    buf[17] = clip_u8((battery_voltage + 10) / 20);
+    buf[18] = clip_u8((pyro_voltage + 25) / 50);
+    buf[19] = flags;
+    buf[20] = next_rate;
+
+    buf_len = TELEMETRY_FRAME_LENGTH;
+    return true;
+}
@@ -2,6 +2,10 @@
 
 #include <stdint.h>
 
+// Every Nth message goes out as a UKHAS sentence instead of a binary frame,
+// so that receivers learn the callsign
+#define TELEMETRY_ASCII_INTERVAL    6
+
 // Class to keep track of our last known status (telemetry data)
 struct TeleMessage {
     char     callsign[16];
@@ -22,6 +26,8 @@ struct TeleMessage {
     uint16_t pyro_voltage;      // millivolts
 
     uint8_t  pyro_state;
+    uint8_t  flight_state;      // AppState::State
+    uint8_t  next_rate;         // announced rate index (lora/link_rate.h)
 
     uint16_t msg_recv;
     int8_t   rssi_last;
@@ -30,4 +36,6 @@ struct TeleMessage {
     void save();
 
     bool build_string(char *buf, int &buf_len);
+    // Packed frame, see lora/telemetry_frame.h
+    bool build_binary(uint8_t *buf, int &buf_len);
 };
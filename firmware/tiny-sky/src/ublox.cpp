@@ -37,6 +37,41 @@ void ublox_enable_trkd5() {
     ublox_command(0x06, 0x01, payload, sizeof(payload));
 }
 
+void ublox_cfg_ubx_only(uint32_t baudrate) {
+    const uint8_t payload[] = {
+        0x01,                   // portID (UART1)
+        0x00,                   // reserved1
+        0x00, 0x00,             // txReady
+        0xD0, 0x08, 0x00, 0x00, // mode (8N1)
+        (uint8_t)(baudrate >> 0), (uint8_t)(baudrate >> 8), 
+        (uint8_t)(baudrate >> 16), (uint8_t)(baudrate >> 24),
+        0x03, 0x00,             // inProtoMask (UBX + NMEA)
+        0x01, 0x00,             // outProtoMask (UBX only)
+        0x00, 0x00,             // flags
+        0x00, 0x00              // reserved2
+    };
+    // message: CFG-PRT
+    ublox_command(0x06, 0x00, payload, sizeof(payload));
+}
+
+void ublox_enable_msg(uint8_t cls, uint8_t id, uint8_t rate) {
+    const uint8_t payload[] = { 
+        cls, id, rate
+    };
+    // message: CFG-MSG (rate on the current port, in navigation epochs)
+    ublox_command(0x06, 0x01, payload, sizeof(payload));
+}
+
+void ublox_set_rate(uint16_t meas_rate_ms) {
+    const uint8_t payload[] = { 
+        (uint8_t)(meas_rate_ms >> 0), (uint8_t)(meas_rate_ms >> 8),
+        0x01, 0x00,             // navRate
+        0x01, 0x00              // timeRef (GPS time)
+    };
+    // message: CFG-RATE
+    ublox_command(0x06, 0x08, payload, sizeof(payload));
+}
+
 void ublox_enable_sfrbx() {
     const uint8_t payload[] = { 
         0x03, 0x0f, 0x01
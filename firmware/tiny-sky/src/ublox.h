@@ -35,6 +35,12 @@ void ublox_mon_ver();
 
 void ublox_set_dyn_mode(ublox_dyn_t dyn);
 
+void ublox_cfg_ubx_only(uint32_t baudrate = 9600);
+
+void ublox_enable_msg(uint8_t cls, uint8_t id, uint8_t rate);
+
+void ublox_set_rate(uint16_t meas_rate_ms);
+
 void ublox_cfg_tp5(
     uint32_t freqPeriod, uint32_t freqPeriodLock, 
     uint32_t pulseLenRatio, uint32_t pulseLenRatioLock, 
@@ -0,0 +1,118 @@
+#!/usr/bin/env python3
+
+# Downloads the tiny-sky flight log over the USB console using the binary
+# 'dump' command and writes the raw log image to a file (which can then be
+# decoded with util/xlog-decode).
+#
+# Frames sent by the board (little endian):
+#   'X' 'L' type(1) offset(4) length(2) payload(length) crc32(4)
+# CRC-32 covers type..payload. Type 'D' carries log data, type 'E' ends the
+# transfer and holds the total log size in the offset field.
+#
+# After a CRC error or timeout the download is restarted from the first missing
+# offset, and --resume continues a previously interrupted download.
+
+import os
+import sys
+import time
+import zlib
+import struct
+import serial
+import argparse
+
+HEADER_SIZE = 9
+MAX_BLOCK = 256
+
+class FrameError(Exception):
+    pass
+
+class FrameTimeout(FrameError):
+    pass
+
+def read_exact(stream, size):
+    data = stream.read(size)
+    if len(data) < size:
+        raise FrameTimeout('timeout')
+    return data
+
+def read_frame(stream):
+    # Skip anything (e.g. command echo) until the frame start marker
+    sync = b''
+    while sync != b'XL':
+        ch = stream.read(1)
+        if not ch:
+            raise FrameTimeout('timeout')
+        sync = (sync + ch)[-2:]
+
+    header = read_exact(stream, HEADER_SIZE - 2)
+    (frame_type, offset, length) = struct.unpack('<cLH', header)
+    if length > MAX_BLOCK:
+        raise FrameError('bad length %d' % length)
+    payload = read_exact(stream, length)
+    (crc,) = struct.unpack('<L', read_exact(stream, 4))
+    if zlib.crc32(header + payload) & 0xFFFFFFFF != crc:
+        raise FrameError('CRC mismatch')
+    return (frame_type, offset, payload)
+
+def request(stream, offset):
+    stream.write(('dump %d\n' % offset).encode())
+    stream.flush()
+
+def download(stream, out, offset, retries):
+    errors = 0
+    total = None
+    t_start = time.time()
+    n_bytes = 0
+
+    request(stream, offset)
+    while total is None or offset < total:
+        try:
+            (frame_type, frame_offset, payload) = read_frame(stream)
+        except FrameError as e:
+            errors += 1
+            sys.stderr.write('\n%s, resuming from offset %d\n' % (e, offset))
+            if errors > retries:
+                return False
+            # After a corrupted frame the rest of the stream is skipped until
+            # the end frame, on timeout the request is repeated right away
+            if isinstance(e, FrameTimeout):
+                request(stream, offset)
+            continue
+
+        if frame_type == b'E':
+            total = frame_offset
+            if offset < total:
+                request(stream, offset)
+        elif frame_type == b'D' and frame_offset == offset:
+            out.write(payload)
+            offset += len(payload)
+            n_bytes += len(payload)
+            sys.stderr.write('\r%d bytes' % offset)
+
+    elapsed = time.time() - t_start
+    sys.stderr.write('\r%d of %d bytes, %.1f kB/s, %d errors\n' %
+        (offset, total, n_bytes / 1024.0 / max(elapsed, 1e-3), errors))
+    return True
+
+def main(args):
+    parser = argparse.ArgumentParser(description = 'Download tiny-sky flight log over USB')
+    parser.add_argument('port', help = 'serial port of the board (e.g. /dev/ttyACM0)')
+    parser.add_argument('output', help = 'file to write the raw log image to')
+    parser.add_argument('--resume', action = 'store_true', help = 'continue a partial download')
+    parser.add_argument('--retries', type = int, default = 10, help = 'maximum number of restarts')
+    args = parser.parse_args(args)
+
+    offset = 0
+    mode = 'wb'
+    if args.resume and os.path.exists(args.output):
+        offset = os.path.getsize(args.output)
+        mode = 'ab'
+
+    stream = serial.Serial(args.port, 115200, timeout = 1.0)
+    with open(args.output, mode) as out:
+        ok = download(stream, out, offset, args.retries)
+    stream.close()
+    return 0 if ok else 1
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
@@ -0,0 +1,655 @@
+// Decodes a tiny-sky flight log image (as written by xlog_* in storage.cpp and
+// downloaded with log-download.py) into per-sensor column tables.
+//
+// The image is memory mapped and decoded in a single pass. Records that cannot
+// be decoded are reported with their offsets and skipped, decoding resumes at
+// the next valid record. Both the sector/frame based log format and the older
+// unframed format (tag + timestamp + payload) are recognized.
+//
+// Usage: xlog-decode [-c] [-b] [-o prefix] image.bin
+//   -c         write CSV tables (<prefix>.<table>.csv), the default
+//   -b         write all tables into one binary columnar file (<prefix>.xcol)
+//   -o prefix  output file prefix (default: image file name without extension)
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+enum {
+    TAG_ARM     = 0x00,
+    TAG_BARO    = 0x01,
+    TAG_MAG     = 0x02,
+    TAG_POS     = 0x04,
+    TAG_IMU     = 0x05,
+    TAG_TIME    = 0x0F,
+    TAG_EJECT   = 0x10,
+    TAG_BLOCK   = 0x20,
+    TAG_ERASED  = 0xFF
+};
+
+// Framed log format, see storage.cpp
+static const size_t SECTOR_SIZE     = 4096;
+static const size_t HEADER_SIZE     = 12;
+static const size_t FRAME_OVERHEAD  = 6;
+
+// Column types in the binary format
+enum {
+    COL_I8 = 1, COL_U8, COL_I16, COL_U16, COL_I32, COL_U32, COL_F32, COL_F64
+};
+
+struct Column {
+    const char *name;
+    int         type;
+    const void *data;
+};
+
+struct Table {
+    const char          *name;
+    size_t              rows;
+    std::vector<Column> columns;
+};
+
+struct EventTable {
+    std::vector<uint32_t>   time;
+    std::vector<uint8_t>    type;       // record tag
+    std::vector<uint8_t>    hour, minute, second;
+};
+
+struct BaroTable {
+    std::vector<uint32_t>   time;
+    std::vector<uint32_t>   pressure;   // Pa
+    std::vector<int8_t>     temp;       // C
+};
+
+struct MagTable {
+    std::vector<uint32_t>   time;
+    std::vector<int16_t>    mag_x;
+    std::vector<int8_t>     temp;       // C
+};
+
+struct PosTable {
+    std::vector<uint32_t>   time;
+    std::vector<double>     lat, lon;   // degrees
+    std::vector<int16_t>    alt;        // m
+};
+
+struct IMUTable {
+    std::vector<double>     time;       // ms, interpolated within a batch
+    std::vector<int16_t>    gx, gy, gz;
+    std::vector<int16_t>    ax, ay, az;
+};
+
+struct Log {
+    EventTable  events;
+    BaroTable   baro;
+    MagTable    mag;
+    PosTable    pos;
+    IMUTable    imu;
+
+    size_t      records;
+    size_t      corrupt;        // number of undecodable regions
+    size_t      corrupt_bytes;
+    size_t      truncated;
+    size_t      lost;           // records missing according to sequence numbers
+    size_t      boots;
+};
+
+static uint16_t get_u16(const uint8_t *p) {
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint8_t crc8(const uint8_t *data, size_t size) {
+    uint8_t crc = 0xFF;
+    for (size_t i = 0; i < size; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x80) ? ((crc << 1) ^ 0x07) : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+// Returns the full length of the record at ptr, 0 for an unknown tag
+static size_t record_length(const uint8_t *ptr, size_t avail) {
+    switch (ptr[0]) {
+        case TAG_ARM:   return 8;
+        case TAG_BARO:  return 8;
+        case TAG_MAG:   return 8;
+        case TAG_POS:   return 15;
+        case TAG_EJECT: return 5;
+        case TAG_IMU:
+            if (avail < 8) return 8;
+            return 8 + 12 * (size_t)ptr[5];
+    }
+    return 0;
+}
+
+// Used for resynchronizing after corrupt data: the record must have a known
+// tag and a timestamp not too far from the last good one
+static bool record_plausible(const uint8_t *ptr, size_t avail, bool have_time, uint32_t last_time) {
+    size_t length = record_length(ptr, avail);
+    if (length == 0 || length > avail) return false;
+    if (ptr[0] == TAG_IMU && (ptr[5] == 0 || ptr[5] > 16)) return false;
+    if (!have_time) return true;
+    int32_t dt = (int32_t)(get_u32(ptr + 1) - last_time);
+    return (dt >= -1000 && dt < 3600 * 1000);
+}
+
+// Payload layout is the same in both log formats
+static void decode_record(Log &log, uint8_t tag, uint32_t time, const uint8_t *payload) {
+    switch (tag) {
+        case TAG_ARM:
+        case TAG_EJECT:
+            log.events.time.push_back(time);
+            log.events.type.push_back(tag);
+            log.events.hour.push_back(tag == TAG_ARM ? payload[0] : 0);
+            log.events.minute.push_back(tag == TAG_ARM ? payload[1] : 0);
+            log.events.second.push_back(tag == TAG_ARM ? payload[2] : 0);
+            break;
+        case TAG_BARO:
+            log.baro.time.push_back(time);
+            log.baro.pressure.push_back(2 * (uint32_t)get_u16(payload + 0));
+            log.baro.temp.push_back((int8_t)payload[2]);
+            break;
+        case TAG_MAG:
+            log.mag.time.push_back(time);
+            log.mag.mag_x.push_back((int16_t)get_u16(payload + 0));
+            log.mag.temp.push_back((int8_t)payload[2]);
+            break;
+        case TAG_POS:
+            log.pos.time.push_back(time);
+            log.pos.alt.push_back((int16_t)get_u16(payload + 0));
+            log.pos.lat.push_back((int32_t)get_u32(payload + 2) * 1.0E-7);
+            log.pos.lon.push_back((int32_t)get_u32(payload + 6) * 1.0E-7);
+            break;
+        case TAG_IMU: {
+            int count = payload[0];
+            double interval_ms = get_u16(payload + 1) / 1000.0;
+            const uint8_t *sample = payload + 3;
+            for (int i = 0; i < count; i++, sample += 12) {
+                log.imu.time.push_back(time - (count - 1 - i) * interval_ms);
+                log.imu.gx.push_back((int16_t)get_u16(sample + 0));
+                log.imu.gy.push_back((int16_t)get_u16(sample + 2));
+                log.imu.gz.push_back((int16_t)get_u16(sample + 4));
+                log.imu.ax.push_back((int16_t)get_u16(sample + 6));
+                log.imu.ay.push_back((int16_t)get_u16(sample + 8));
+                log.imu.az.push_back((int16_t)get_u16(sample + 10));
+            }
+            break;
+        }
+    }
+    log.records++;
+}
+
+static void decode_legacy(Log &log, const uint8_t *data, size_t size) {
+    // Most records are 8 bytes
+    log.baro.time.reserve(size / 16);
+    log.mag.time.reserve(size / 16);
+
+    bool     have_time = false;
+    uint32_t last_time = 0;
+    size_t   idx = 0;
+
+    while (idx < size) {
+        const uint8_t *ptr = data + idx;
+        size_t avail = size - idx;
+
+        if (ptr[0] == TAG_ERASED) {
+            // Erased flash, either the end of the log or a gap left by a reset
+            size_t end = idx;
+            while (end < size && data[end] == 0xFF) end++;
+            if (end < size) {
+                fprintf(stderr, "Gap of %zu erased bytes at offset %zu\n", end - idx, idx);
+            }
+            idx = end;
+            continue;
+        }
+
+        size_t length = record_length(ptr, avail);
+        if (length > avail) {
+            fprintf(stderr, "Truncated record (tag %02Xh) at offset %zu\n", ptr[0], idx);
+            log.truncated++;
+            break;
+        }
+        if (length == 0 || !record_plausible(ptr, avail, have_time, last_time)) {
+            // Skip to the next plausible record
+            size_t end = idx + 1;
+            while (end < size && data[end] != 0xFF && !record_plausible(data + end, size - end, have_time, last_time)) {
+                end++;
+            }
+            fprintf(stderr, "Corrupt data (%zu bytes) at offset %zu\n", end - idx, idx);
+            log.corrupt++;
+            log.corrupt_bytes += end - idx;
+            idx = end;
+            continue;
+        }
+
+        decode_record(log, ptr[0], get_u32(ptr + 1), ptr + 5);
+        last_time = get_u32(ptr + 1);
+        have_time = true;
+        idx += length;
+    }
+}
+
+// Checks for a complete frame with a known tag, the right payload length
+// and a matching CRC
+static bool frame_valid(const uint8_t *ptr, size_t avail) {
+    if (avail < FRAME_OVERHEAD) return false;
+    size_t payload = ptr[1];
+    switch (ptr[0]) {
+        case TAG_ARM:   if (payload != 3) return false; break;
+        case TAG_BARO:  if (payload != 3) return false; break;
+        case TAG_MAG:   if (payload != 3) return false; break;
+        case TAG_POS:   if (payload != 10) return false; break;
+        case TAG_TIME:  if (payload != 4) return false; break;
+        case TAG_EJECT: if (payload != 0) return false; break;
+        case TAG_BLOCK: if (payload == 0) return false; break;
+        case TAG_IMU:
+            if (payload < 3 || payload != 3 + 12 * (size_t)ptr[5]) return false;
+            break;
+        default:
+            return false;
+    }
+    size_t length = FRAME_OVERHEAD + payload;
+    if (length > avail) return false;
+    return (crc8(ptr, length - 1) == ptr[length - 1]);
+}
+
+// Previous baro/mag sample for delta decoding
+struct DeltaState {
+    bool    valid;
+    int32_t value;
+    int32_t temp;
+};
+
+static bool get_varint(const uint8_t *&ptr, const uint8_t *end, uint32_t &value) {
+    value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (ptr >= end) return false;
+        uint8_t byte = *ptr++;
+        value |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+static bool get_zigzag(const uint8_t *&ptr, const uint8_t *end, int32_t &value) {
+    uint32_t raw;
+    if (!get_varint(ptr, end, raw)) return false;
+    value = (int32_t)(raw >> 1) ^ -(int32_t)(raw & 1);
+    return true;
+}
+
+// Decodes the delta coded baro/mag entries of a block record
+static bool decode_block(Log &log, uint32_t time, const uint8_t *ptr, size_t length, DeltaState *pred) {
+    const uint8_t *end = ptr + length;
+    while (ptr < end) {
+        uint8_t hdr = *ptr++;
+        int type = hdr >> 6;
+        if (type > 1 || !pred[type].valid) return false;
+
+        int32_t dt = hdr & 0x1F;
+        if (dt == 31 && !get_zigzag(ptr, end, dt)) return false;
+        int32_t delta;
+        if (!get_zigzag(ptr, end, delta)) return false;
+        int32_t temp_delta = 0;
+        if ((hdr & 0x20) && !get_zigzag(ptr, end, temp_delta)) return false;
+
+        time += dt;
+        pred[type].value += delta;
+        pred[type].temp += temp_delta;
+        if (type == 0) {
+            log.baro.time.push_back(time);
+            log.baro.pressure.push_back(2 * (uint32_t)(uint16_t)pred[type].value);
+            log.baro.temp.push_back((int8_t)pred[type].temp);
+        }
+        else {
+            log.mag.time.push_back(time);
+            log.mag.mag_x.push_back((int16_t)pred[type].value);
+            log.mag.temp.push_back((int8_t)pred[type].temp);
+        }
+        log.records++;
+    }
+    return true;
+}
+
+static void decode_sector(Log &log, const uint8_t *data, size_t offset, size_t avail, bool last, uint8_t &seq) {
+    const uint8_t *sector = data + offset;
+    uint32_t base_time = get_u32(sector + 6);
+    size_t idx = HEADER_SIZE;
+    DeltaState pred[2] = {};
+
+    while (idx < avail) {
+        const uint8_t *ptr = sector + idx;
+        if (ptr[0] == TAG_ERASED) {
+            // Rest of the sector should be erased
+            size_t end = idx;
+            while (end < avail && sector[end] == 0xFF) end++;
+            if (end == avail) break;
+            fprintf(stderr, "Gap of %zu erased bytes at offset %zu\n", end - idx, offset + idx);
+            idx = end;
+            continue;
+        }
+
+        if (!frame_valid(ptr, avail - idx)) {
+            if (last && idx + FRAME_OVERHEAD + (avail - idx >= 2 ? ptr[1] : 0) > avail) {
+                fprintf(stderr, "Truncated record (tag %02Xh) at offset %zu\n", ptr[0], offset + idx);
+                log.truncated++;
+                break;
+            }
+            // Skip to the next valid frame in this sector
+            size_t end = idx + 1;
+            while (end < avail && !frame_valid(sector + end, avail - end)) end++;
+            fprintf(stderr, "Corrupt data (%zu bytes) at offset %zu\n", end - idx, offset + idx);
+            log.corrupt++;
+            log.corrupt_bytes += end - idx;
+            idx = end;
+            // A keyframe may have been lost
+            pred[0].valid = false;
+            pred[1].valid = false;
+            continue;
+        }
+
+        if (ptr[2] != seq) {
+            log.lost += (uint8_t)(ptr[2] - seq);
+        }
+        seq = ptr[2] + 1;
+
+        const uint8_t *payload = ptr + 5;
+        if (ptr[0] == TAG_TIME) {
+            base_time = get_u32(payload);
+        }
+        else if (ptr[0] == TAG_BLOCK) {
+            if (!decode_block(log, base_time + get_u16(ptr + 3), payload, ptr[1], pred)) {
+                fprintf(stderr, "Undecodable delta block at offset %zu\n", offset + idx);
+                log.corrupt++;
+                log.corrupt_bytes += FRAME_OVERHEAD + ptr[1];
+            }
+            // Following samples start from a keyframe again
+            pred[0].valid = false;
+            pred[1].valid = false;
+        }
+        else {
+            if (ptr[0] == TAG_BARO || ptr[0] == TAG_MAG) {
+                // Keyframe for the following delta block
+                DeltaState &state = pred[ptr[0] == TAG_BARO ? 0 : 1];
+                state.valid = true;
+                state.value = (ptr[0] == TAG_BARO) ? (int32_t)get_u16(payload) : (int16_t)get_u16(payload);
+                state.temp = (int8_t)payload[2];
+            }
+            decode_record(log, ptr[0], base_time + get_u16(ptr + 3), payload);
+        }
+        idx += FRAME_OVERHEAD + ptr[1];
+    }
+}
+
+static void decode_framed(Log &log, const uint8_t *data, size_t size) {
+    bool     have_boot = false;
+    uint16_t boot = 0;
+    uint8_t  seq = 0;
+
+    for (size_t offset = 0; offset < size; offset += SECTOR_SIZE) {
+        const uint8_t *header = data + offset;
+        size_t avail = std::min(SECTOR_SIZE, size - offset);
+        if (avail < HEADER_SIZE) {
+            fprintf(stderr, "Truncated sector at offset %zu\n", offset);
+            log.truncated++;
+            break;
+        }
+
+        bool erased = true;
+        for (size_t i = 0; i < HEADER_SIZE; i++) {
+            if (header[i] != 0xFF) erased = false;
+        }
+        if (erased) continue;
+
+        if (header[0] != 'X' || header[1] != 'S' || crc8(header, HEADER_SIZE - 1) != header[HEADER_SIZE - 1]) {
+            fprintf(stderr, "Corrupt sector header at offset %zu, skipping sector\n", offset);
+            log.corrupt++;
+            log.corrupt_bytes += avail;
+            continue;
+        }
+
+        // Sequence numbers restart with every boot
+        uint16_t sector_boot = get_u16(header + 4);
+        if (!have_boot || sector_boot != boot) {
+            have_boot = true;
+            boot = sector_boot;
+            seq = header[3];
+            log.boots++;
+        }
+        else if (header[3] != seq) {
+            log.lost += (uint8_t)(header[3] - seq);
+            seq = header[3];
+        }
+
+        decode_sector(log, data, offset, avail, offset + SECTOR_SIZE > size, seq);
+    }
+}
+
+static void decode_log(Log &log, const uint8_t *data, size_t size) {
+    if (size >= 2 && data[0] == 'X' && data[1] == 'S') {
+        decode_framed(log, data, size);
+    }
+    else {
+        decode_legacy(log, data, size);
+    }
+}
+
+static std::vector<Table> make_tables(const Log &log) {
+    std::vector<Table> tables;
+
+    tables.push_back(Table{"events", log.events.time.size(), {
+        {"time_ms", COL_U32, log.events.time.data()},
+        {"type",    COL_U8,  log.events.type.data()},
+        {"hour",    COL_U8,  log.events.hour.data()},
+        {"minute",  COL_U8,  log.events.minute.data()},
+        {"second",  COL_U8,  log.events.second.data()},
+    }});
+    tables.push_back(Table{"baro", log.baro.time.size(), {
+        {"time_ms",     COL_U32, log.baro.time.data()},
+        {"pressure_pa", COL_U32, log.baro.pressure.data()},
+        {"temp_c",      COL_I8,  log.baro.temp.data()},
+    }});
+    tables.push_back(Table{"mag", log.mag.time.size(), {
+        {"time_ms", COL_U32, log.mag.time.data()},
+        {"mag_x",   COL_I16, log.mag.mag_x.data()},
+        {"temp_c",  COL_I8,  log.mag.temp.data()},
+    }});
+    tables.push_back(Table{"pos", log.pos.time.size(), {
+        {"time_ms", COL_U32, log.pos.time.data()},
+        {"lat",     COL_F64, log.pos.lat.data()},
+        {"lon",     COL_F64, log.pos.lon.data()},
+        {"alt_m",   COL_I16, log.pos.alt.data()},
+    }});
+    tables.push_back(Table{"imu", log.imu.time.size(), {
+        {"time_ms", COL_F64, log.imu.time.data()},
+        {"gx",      COL_I16, log.imu.gx.data()},
+        {"gy",      COL_I16, log.imu.gy.data()},
+        {"gz",      COL_I16, log.imu.gz.data()},
+        {"ax",      COL_I16, log.imu.ax.data()},
+        {"ay",      COL_I16, log.imu.ay.data()},
+        {"az",      COL_I16, log.imu.az.data()},
+    }});
+    return tables;
+}
+
+static size_t column_width(int type) {
+    switch (type) {
+        case COL_I8:  case COL_U8:  return 1;
+        case COL_I16: case COL_U16: return 2;
+        case COL_I32: case COL_U32: case COL_F32: return 4;
+        case COL_F64: return 8;
+    }
+    return 0;
+}
+
+static int format_value(char *buf, int type, const void *data, size_t row) {
+    switch (type) {
+        case COL_I8:  return sprintf(buf, "%d", ((const int8_t *)data)[row]);
+        case COL_U8:  return sprintf(buf, "%u", ((const uint8_t *)data)[row]);
+        case COL_I16: return sprintf(buf, "%d", ((const int16_t *)data)[row]);
+        case COL_U16: return sprintf(buf, "%u", ((const uint16_t *)data)[row]);
+        case COL_I32: return sprintf(buf, "%d", ((const int32_t *)data)[row]);
+        case COL_U32: return sprintf(buf, "%u", ((const uint32_t *)data)[row]);
+        case COL_F32: return sprintf(buf, "%.7g", ((const float *)data)[row]);
+        case COL_F64: return sprintf(buf, "%.10g", ((const double *)data)[row]);
+    }
+    return 0;
+}
+
+static bool write_csv(const Table &table, const std::string &path) {
+    FILE *f = fopen(path.c_str(), "w");
+    if (!f) {
+        perror(path.c_str());
+        return false;
+    }
+    for (size_t c = 0; c < table.columns.size(); c++) {
+        fprintf(f, "%s%s", (c > 0) ? "," : "", table.columns[c].name);
+    }
+    fputc('\n', f);
+
+    char line[256];
+    for (size_t row = 0; row < table.rows; row++) {
+        int len = 0;
+        for (size_t c = 0; c < table.columns.size(); c++) {
+            if (c > 0) line[len++] = ',';
+            len += format_value(line + len, table.columns[c].type, table.columns[c].data, row);
+        }
+        line[len++] = '\n';
+        fwrite(line, 1, len, f);
+    }
+    return (fclose(f) == 0);
+}
+
+// Binary columnar file (little endian):
+//   "XCOL" version(u32) n_tables(u32)
+//   per table: name(char[16]) rows(u64) n_columns(u32)
+//              per column: name(char[16]) type(u32)
+//              column data, one contiguous array per column
+static bool write_binary(const std::vector<Table> &tables, const std::string &path) {
+    FILE *f = fopen(path.c_str(), "wb");
+    if (!f) {
+        perror(path.c_str());
+        return false;
+    }
+
+    auto put_u32 = [f](uint32_t x) { fwrite(&x, 4, 1, f); };
+    auto put_u64 = [f](uint64_t x) { fwrite(&x, 8, 1, f); };
+    auto put_name = [f](const char *name) {
+        char buf[16] = {0};
+        strncpy(buf, name, sizeof(buf) - 1);
+        fwrite(buf, 1, sizeof(buf), f);
+    };
+
+    fwrite("XCOL", 1, 4, f);
+    put_u32(1);
+    put_u32(tables.size());
+    for (const Table &table : tables) {
+        put_name(table.name);
+        put_u64(table.rows);
+        put_u32(table.columns.size());
+        for (const Column &column : table.columns) {
+            put_name(column.name);
+            put_u32(column.type);
+        }
+        for (const Column &column : table.columns) {
+            if (table.rows > 0) {
+                fwrite(column.data, column_width(column.type), table.rows, f);
+            }
+        }
+    }
+    return (fclose(f) == 0);
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "Usage: %s [-c] [-b] [-o prefix] image.bin\n", argv0);
+}
+
+int main(int argc, char **argv) {
+    bool        out_csv = false;
+    bool        out_binary = false;
+    std::string prefix;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "cbo:h")) != -1) {
+        switch (opt) {
+            case 'c': out_csv = true; break;
+            case 'b': out_binary = true; break;
+            case 'o': prefix = optarg; break;
+            default:
+                usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind + 1 != argc) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (!out_binary) out_csv = true;
+
+    const char *path = argv[optind];
+    if (prefix.empty()) {
+        prefix = path;
+        size_t dot = prefix.rfind('.');
+        size_t slash = prefix.rfind('/');
+        if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) {
+            prefix.erase(dot);
+        }
+    }
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        perror(path);
+        return 1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        perror(path);
+        return 1;
+    }
+    size_t size = st.st_size;
+    const uint8_t *data = 0;
+    if (size > 0) {
+        data = (const uint8_t *)mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            perror(path);
+            return 1;
+        }
+        madvise((void *)data, size, MADV_SEQUENTIAL);
+    }
+
+    Log log = {};
+    decode_log(log, data, size);
+
+    if (size > 0) munmap((void *)data, size);
+    close(fd);
+
+    fprintf(stderr, "%zu bytes, %zu boots, %zu records, %zu lost, %zu corrupt regions (%zu bytes), %zu truncated\n",
+        size, log.boots, log.records, log.lost, log.corrupt, log.corrupt_bytes, log.truncated);
+
+    std::vector<Table> tables = make_tables(log);
+    bool ok = true;
+    if (out_csv) {
+        for (const Table &table : tables) {
+            ok &= write_csv(table, prefix + "." + table.name + ".csv");
+        }
+    }
+    if (out_binary) {
+        ok &= write_binary(tables, prefix + ".xcol");
+    }
+    return ok ? 0 : 1;
+}